@@ -19,7 +19,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
 #include "procfs.h"
+#include "memstat.h"
 
 struct dircat_node
 {
@@ -73,11 +75,25 @@ dircat_lookup (void *hook, const char *name, struct node **np)
 
   err = ENOENT;
   for (i=0; err && i < dcn->num_dirs; i++)
-    err = procfs_lookup (dcn->dirs[i], name, np);
+    err = procfs_lookup_delegate (dcn->dirs[i], name, np);
 
   return err;
 }
 
+static unsigned char
+dircat_get_dirent_type (void *hook, const char *name)
+{
+  struct dircat_node *dcn = hook;
+  unsigned char type;
+  int i;
+
+  type = DT_UNKNOWN;
+  for (i=0; type == DT_UNKNOWN && i < dcn->num_dirs; i++)
+    type = procfs_get_dirent_type (dcn->dirs[i], name);
+
+  return type;
+}
+
 static void
 dircat_release_dirs (struct node *const *dirs, int num_dirs)
 {
@@ -94,6 +110,8 @@ dircat_cleanup (void *hook)
   struct dircat_node *dcn = hook;
 
   dircat_release_dirs (dcn->dirs, dcn->num_dirs);
+  memstat_free (MEMSTAT_DIRS,
+		sizeof *dcn + dcn->num_dirs * sizeof dcn->dirs[0]);
   free (dcn);
 }
 
@@ -105,6 +123,7 @@ dircat_make_node (struct node *const *dirs, int num_dirs)
     .cleanup_contents = procfs_cleanup_contents_with_free,
     .lookup = dircat_lookup,
     .cleanup = dircat_cleanup,
+    .get_dirent_type = dircat_get_dirent_type,
   };
   struct dircat_node *dcn;
   int i;
@@ -119,6 +138,7 @@ dircat_make_node (struct node *const *dirs, int num_dirs)
 
   dcn->num_dirs = num_dirs;
   memcpy (dcn->dirs, dirs, num_dirs * sizeof dcn->dirs[0]);
+  memstat_alloc (MEMSTAT_DIRS, sizeof *dcn + num_dirs * sizeof dcn->dirs[0]);
   return procfs_make_node (&ops, dcn);
 
 fail:
@@ -0,0 +1,397 @@
+/* Hurd /proc filesystem, recent history of the host statistics.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <mach.h>
+#include <mach/vm_param.h>
+#include <mach/vm_statistics.h>
+#include <mach/vm_cache_statistics.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "procfs.h"
+#include "procfs_dir.h"
+#include "hosthist.h"
+#include "main.h"
+
+/* To help with the analysis of an incident after the fact, a thread
+   samples the memory and load statistics every --history-interval
+   seconds, and the last HOSTHIST_SIZE samples are available in the
+   hosthistory file, much like what sar would record.  */
+
+/* The number of samples kept.  */
+#define HOSTHIST_SIZE 300
+
+struct hosthist_sample
+{
+  time_t time;
+
+  /* In pages.  */
+  unsigned long free, active, inactive, wired, cached;
+
+  /* Cumulative counts.  */
+  unsigned long pageins, pageouts, faults;
+
+  /* As given by HOST_LOAD_INFO.  */
+  unsigned long load[3];
+
+  /* Whether free memory was below --pressure-threshold, and whether pages
+     were also paged out since the previous sample.  */
+  int low, full;
+};
+
+static pthread_mutex_t hosthist_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct hosthist_sample hosthist_samples[HOSTHIST_SIZE];
+static unsigned long hosthist_count;
+
+/* The total time spent with free memory below the threshold, and while
+   paging out as well, in microseconds, as far as the samples tell.  */
+static unsigned long long hosthist_low_usecs;
+static unsigned long long hosthist_full_usecs;
+
+static void
+hosthist_sample (void)
+{
+  struct hosthist_sample s, *prev;
+  struct vm_statistics vmstats;
+  struct vm_cache_statistics cache_stats;
+  host_load_info_data_t hli;
+  mach_msg_type_number_t cnt;
+  unsigned long total;
+  int i;
+
+  if (vm_statistics (mach_task_self (), &vmstats)
+      || vm_cache_statistics (mach_task_self (), &cache_stats))
+    return;
+
+  cnt = HOST_LOAD_INFO_COUNT;
+  if (host_info (mach_host_self (), HOST_LOAD_INFO, (host_info_t) &hli, &cnt))
+    return;
+
+  s.time = time (NULL);
+  s.free = vmstats.free_count;
+  s.active = vmstats.active_count;
+  s.inactive = vmstats.inactive_count;
+  s.wired = vmstats.wire_count;
+  s.cached = cache_stats.cache_count;
+  s.pageins = vmstats.pageins;
+  s.pageouts = vmstats.pageouts;
+  s.faults = vmstats.faults;
+  for (i = 0; i < 3; i++)
+    s.load[i] = hli.avenrun[i];
+
+  total = s.free + s.active + s.inactive + s.wired;
+  s.low = s.free * 100 < total * opt_pressure_threshold;
+
+  s.full = 0;
+
+  pthread_mutex_lock (&hosthist_lock);
+  if (hosthist_count && s.low)
+    {
+      prev = &hosthist_samples[(hosthist_count - 1) % HOSTHIST_SIZE];
+      s.full = s.pageouts != prev->pageouts;
+      hosthist_low_usecs += (s.time - prev->time) * 1000000ULL;
+      if (s.full)
+	hosthist_full_usecs += (s.time - prev->time) * 1000000ULL;
+    }
+  hosthist_samples[hosthist_count++ % HOSTHIST_SIZE] = s;
+  pthread_mutex_unlock (&hosthist_lock);
+}
+
+static void *
+hosthist_thread (void *arg)
+{
+  for (;;)
+    {
+      /* The interval can be changed at runtime, or set to 0 to stop
+	 sampling.  */
+      if (opt_history_interval > 0)
+	hosthist_sample ();
+      sleep (opt_history_interval > 0 ? opt_history_interval : 1);
+    }
+
+  return NULL;
+}
+
+error_t
+hosthist_start (void)
+{
+  pthread_t thread;
+  error_t err;
+
+  err = pthread_create (&thread, NULL, hosthist_thread, NULL);
+  if (err)
+    return err;
+
+  pthread_detach (thread);
+  return 0;
+}
+
+
+/* The hosthistory file */
+
+#define PAGES_KB(n) ((n) * (PAGE_SIZE / 1024))
+
+/* One line per sample, from the oldest one.  The memory sizes are in
+   kilobytes, and the page-ins, page-outs and faults are those which
+   happened since the previous sample.  */
+static error_t
+hosthist_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  struct hosthist_sample *s, *prev;
+  unsigned long i, first;
+  size_t len;
+  FILE *m;
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  fprintf (m, "%-10s %10s %10s %10s %10s %10s %7s %7s %7s %5s %5s %5s\n",
+	   "time", "free", "cached", "active", "inactive", "wired",
+	   "pgpgin", "pgpgout", "pgfault", "load1", "load5", "load15");
+
+  pthread_mutex_lock (&hosthist_lock);
+
+  /* The oldest sample is only used as a reference for the deltas.  */
+  first = hosthist_count > HOSTHIST_SIZE ? hosthist_count - HOSTHIST_SIZE : 0;
+  for (i = first + 1; i < hosthist_count; i++)
+    {
+      s = &hosthist_samples[i % HOSTHIST_SIZE];
+      prev = &hosthist_samples[(i - 1) % HOSTHIST_SIZE];
+
+      fprintf (m, "%-10ld %10lu %10lu %10lu %10lu %10lu %7lu %7lu %7lu "
+	       "%5.2f %5.2f %5.2f\n",
+	       (long) s->time,
+	       PAGES_KB (s->free), PAGES_KB (s->cached),
+	       PAGES_KB (s->active), PAGES_KB (s->inactive),
+	       PAGES_KB (s->wired),
+	       s->pageins - prev->pageins, s->pageouts - prev->pageouts,
+	       s->faults - prev->faults,
+	       s->load[0] / (double) LOAD_SCALE,
+	       s->load[1] / (double) LOAD_SCALE,
+	       s->load[2] / (double) LOAD_SCALE);
+    }
+
+  pthread_mutex_unlock (&hosthist_lock);
+
+  fclose (m);
+  *contents_len = len;
+  return 0;
+}
+
+struct node *
+hosthist_make_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = hosthist_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, NULL);
+}
+
+
+/* The pressure directory */
+
+/* The windows over which the pressure is averaged, in seconds.  */
+static const int hosthist_windows[] = { 10, 60, 300 };
+#define HOSTHIST_NUM_WINDOWS \
+  (sizeof hosthist_windows / sizeof hosthist_windows[0])
+
+/* The indicators computed over a window.  */
+struct hosthist_pressure
+{
+  /* The percentages of the samples in which free memory was low, and in
+     which pages were paged out as well.  */
+  double some, full;
+
+  /* The page-out and fault rates per second.  */
+  double pageouts, faults;
+};
+
+/* Compute the indicators over the last WINDOW seconds into P.  The
+   history must be locked and not empty.  */
+static void
+hosthist_pressure (int window, struct hosthist_pressure *p)
+{
+  struct hosthist_sample *last, *first, *s;
+  unsigned long i, oldest, n, nlow, nfull;
+  time_t elapsed;
+
+  oldest = hosthist_count > HOSTHIST_SIZE ? hosthist_count - HOSTHIST_SIZE : 0;
+  last = &hosthist_samples[(hosthist_count - 1) % HOSTHIST_SIZE];
+  first = last;
+
+  for (i = hosthist_count, n = nlow = nfull = 0; i > oldest; i--)
+    {
+      s = &hosthist_samples[(i - 1) % HOSTHIST_SIZE];
+      if (last->time - s->time > window)
+	break;
+
+      first = s;
+      n++;
+      nlow += s->low;
+      nfull += s->full;
+    }
+
+  p->some = nlow * 100. / n;
+  p->full = nfull * 100. / n;
+
+  elapsed = last->time - first->time;
+  p->pageouts = elapsed ? (last->pageouts - first->pageouts) / (double) elapsed
+			: 0;
+  p->faults = elapsed ? (last->faults - first->faults) / (double) elapsed : 0;
+}
+
+/* Compute the indicators over each of the windows into P.  */
+static void
+hosthist_pressure_all (struct hosthist_pressure p[HOSTHIST_NUM_WINDOWS])
+{
+  int w;
+
+  for (w = 0; w < HOSTHIST_NUM_WINDOWS; w++)
+    if (hosthist_count)
+      hosthist_pressure (hosthist_windows[w], &p[w]);
+    else
+      memset (&p[w], 0, sizeof p[w]);
+}
+
+/* The memory file of the pressure directory of Linux, with averages over
+   the last 10, 60 and 300 seconds, and the total time in microseconds.
+   Since Mach doesn't tell how long the tasks were stalled, the "some"
+   line gives the percentage of the time free memory was below
+   --pressure-threshold percent of the physical memory, and the "full"
+   line the percentage of the time pages were also being paged out.  */
+static error_t
+hosthist_pressure_memory_get_contents (void *hook, char **contents,
+				       ssize_t *contents_len)
+{
+  struct hosthist_pressure p[HOSTHIST_NUM_WINDOWS];
+  unsigned long long low_usecs, full_usecs;
+  size_t len;
+  int w;
+  FILE *m;
+
+  pthread_mutex_lock (&hosthist_lock);
+  hosthist_pressure_all (p);
+  low_usecs = hosthist_low_usecs;
+  full_usecs = hosthist_full_usecs;
+  pthread_mutex_unlock (&hosthist_lock);
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  fprintf (m, "some");
+  for (w = 0; w < HOSTHIST_NUM_WINDOWS; w++)
+    fprintf (m, " avg%d=%.2f", hosthist_windows[w], p[w].some);
+  fprintf (m, " total=%llu\n", low_usecs);
+
+  fprintf (m, "full");
+  for (w = 0; w < HOSTHIST_NUM_WINDOWS; w++)
+    fprintf (m, " avg%d=%.2f", hosthist_windows[w], p[w].full);
+  fprintf (m, " total=%llu\n", full_usecs);
+
+  fclose (m);
+  *contents_len = len;
+  return 0;
+}
+
+static struct node *
+hosthist_pressure_memory_make_node (void *dir_hook, const void *entry_hook)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = hosthist_pressure_memory_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, NULL);
+}
+
+static const struct procfs_dir_entry hosthist_pressure_entries[] = {
+  {
+    .name = "memory",
+    .ops = {
+      .make_node = hosthist_pressure_memory_make_node,
+    }
+  },
+  {}
+};
+
+struct node *
+hosthist_make_pressure_node (void)
+{
+  static const struct procfs_dir_ops ops = {
+    .entries = hosthist_pressure_entries,
+    .entry_ops = {
+      .type = DT_REG,
+    },
+  };
+
+  return procfs_dir_make_node (&ops, NULL);
+}
+
+
+/* The paging file */
+
+/* The average page-out and fault rates per second, over the same windows
+   as the pressure files, in the same format.  */
+static error_t
+hosthist_paging_get_contents (void *hook, char **contents,
+			      ssize_t *contents_len)
+{
+  struct hosthist_pressure p[HOSTHIST_NUM_WINDOWS];
+  size_t len;
+  int w;
+  FILE *m;
+
+  pthread_mutex_lock (&hosthist_lock);
+  hosthist_pressure_all (p);
+  pthread_mutex_unlock (&hosthist_lock);
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  fprintf (m, "pageout");
+  for (w = 0; w < HOSTHIST_NUM_WINDOWS; w++)
+    fprintf (m, " avg%d=%.2f", hosthist_windows[w], p[w].pageouts);
+  fprintf (m, "\nfault");
+  for (w = 0; w < HOSTHIST_NUM_WINDOWS; w++)
+    fprintf (m, " avg%d=%.2f", hosthist_windows[w], p[w].faults);
+  fputc ('\n', m);
+
+  fclose (m);
+  *contents_len = len;
+  return 0;
+}
+
+struct node *
+hosthist_make_paging_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = hosthist_paging_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, NULL);
+}
@@ -0,0 +1,33 @@
+/* Hurd /proc filesystem, recent history of the host statistics.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Start the thread sampling the host statistics every --history-interval
+   seconds.  */
+error_t hosthist_start (void);
+
+/* Create a file listing the recent samples of the host statistics.  */
+struct node *hosthist_make_node (void);
+
+/* Create a directory with a memory file giving indicators of the memory
+   pressure, averaged over the recent samples.  */
+struct node *hosthist_make_pressure_node (void);
+
+/* Create a file giving the page-out and fault rates, averaged over the
+   same windows as the pressure files.  */
+struct node *hosthist_make_paging_node (void);
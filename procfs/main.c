@@ -24,12 +24,18 @@
 #include <argp.h>
 #include <argz.h>
 #include <hurd/netfs.h>
+#include <hurd/ports.h>
 #include <ps.h>
 #include "procfs.h"
 #include "proclist.h"
 #include "rootdir.h"
 #include "dircat.h"
+#include "slabhist.h"
+#include "hosthist.h"
+#include "prewarm.h"
 #include "main.h"
+#include "workers.h"
+#include "throttle.h"
 
 /* Command-line options */
 int opt_clk_tck;
@@ -37,6 +43,17 @@ mode_t opt_stat_mode;
 pid_t opt_fake_self;
 pid_t opt_kernel_pid;
 uid_t opt_anon_owner;
+int opt_max_workers;
+int opt_idle_timeout;
+int opt_max_slow_generators;
+int opt_client_share;
+int opt_trace_threshold;
+int opt_slab_top;
+int opt_slab_interval;
+int opt_history_interval;
+int opt_pressure_threshold;
+int opt_native_mounts;
+int opt_prewarm;
 
 /* Default values */
 #define OPT_CLK_TCK    sysconf(_SC_CLK_TCK)
@@ -44,10 +61,36 @@ uid_t opt_anon_owner;
 #define OPT_FAKE_SELF  -1
 #define OPT_KERNEL_PID 2
 #define OPT_ANON_OWNER 0
+#define OPT_MAX_WORKERS 0
+#define OPT_IDLE_TIMEOUT 120
+#define OPT_MAX_SLOW_GENERATORS 0
+#define OPT_CLIENT_SHARE 0
+#define OPT_TRACE_THRESHOLD 100
+#define OPT_SLAB_TOP 10
+#define OPT_SLAB_INTERVAL 60
+#define OPT_HISTORY_INTERVAL 1
+#define OPT_PRESSURE_THRESHOLD 5
+#define OPT_NATIVE_MOUNTS 0
+#define OPT_PREWARM 0
 
 #define NODEV_KEY  -1 /* <= 0, so no short option. */
 #define NOEXEC_KEY -2 /* Likewise. */
 #define NOSUID_KEY -3 /* Likewise. */
+#define MAX_WORKERS_KEY -4 /* Likewise. */
+#define IDLE_TIMEOUT_KEY -5 /* Likewise. */
+#define MAX_SLOW_GENERATORS_KEY -6 /* Likewise. */
+#define CLIENT_SHARE_KEY -7 /* Likewise. */
+#define TRACE_THRESHOLD_KEY -8 /* Likewise. */
+#define SLAB_TOP_KEY -9 /* Likewise. */
+#define SLAB_INTERVAL_KEY -10 /* Likewise. */
+#define HISTORY_INTERVAL_KEY -11 /* Likewise. */
+#define PRESSURE_THRESHOLD_KEY -12 /* Likewise. */
+#define NATIVE_MOUNTS_KEY -13 /* Likewise. */
+#define PREWARM_KEY -14 /* Likewise. */
+
+/* How long the server waits without any request before trying to go
+   away, in milliseconds.  This is the same as libnetfs.  */
+#define SERVER_TIMEOUT (10 * 60 * 1000)
 
 static error_t
 argp_parser (int key, char *arg, struct argp_state *state)
@@ -117,6 +160,93 @@ argp_parser (int key, char *arg, struct argp_state *state)
 	opt_anon_owner = v;
       break;
 
+    case MAX_WORKERS_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0)
+	argp_error (state, "--max-workers: N should be a non-negative integer");
+      else
+	opt_max_workers = v;
+      break;
+
+    case IDLE_TIMEOUT_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0)
+	argp_error (state, "--idle-timeout: SECONDS should be "
+		    "a non-negative integer");
+      else
+	opt_idle_timeout = v;
+      break;
+
+    case MAX_SLOW_GENERATORS_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0)
+	argp_error (state, "--max-slow-generators: N should be "
+		    "a non-negative integer");
+      else
+	opt_max_slow_generators = v;
+      break;
+
+    case CLIENT_SHARE_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0 || v > 1000)
+	argp_error (state, "--client-share: MS should be "
+		    "an integer between 0 and 1000");
+      else
+	opt_client_share = v;
+      break;
+
+    case TRACE_THRESHOLD_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0)
+	argp_error (state, "--trace-threshold: MS should be "
+		    "a non-negative integer");
+      else
+	opt_trace_threshold = v;
+      break;
+
+    case SLAB_TOP_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0)
+	argp_error (state, "--slab-top: K should be a non-negative integer");
+      else
+	opt_slab_top = v;
+      break;
+
+    case SLAB_INTERVAL_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0)
+	argp_error (state, "--slab-interval: SECONDS should be "
+		    "a non-negative integer");
+      else
+	opt_slab_interval = v;
+      break;
+
+    case HISTORY_INTERVAL_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0)
+	argp_error (state, "--history-interval: SECONDS should be "
+		    "a non-negative integer");
+      else
+	opt_history_interval = v;
+      break;
+
+    case PRESSURE_THRESHOLD_KEY:
+      v = strtol (arg, &endp, 0);
+      if (*endp || ! *arg || v < 0 || v > 100)
+	argp_error (state, "--pressure-threshold: PERCENT should be "
+		    "an integer between 0 and 100");
+      else
+	opt_pressure_threshold = v;
+      break;
+
+    case NATIVE_MOUNTS_KEY:
+      opt_native_mounts = 1;
+      break;
+
+    case PREWARM_KEY:
+      opt_prewarm = 1;
+      break;
+
     case NODEV_KEY:
       /* Ignored for compatibility with Linux' procfs. */
       ;;
@@ -162,6 +292,59 @@ struct argp_option common_options[] = {
       "Be aware that USER will be granted access to the environment and "
       "other sensitive information about the processes in question.  "
       "(default: use uid 0)" },
+  { "max-workers", MAX_WORKERS_KEY, "N", 0,
+      "Serve at most N requests at the same time, with as many threads, "
+      "and queue the others.  The interrupts are still served at once.  "
+      "When changed at runtime to or from 0, this applies once the "
+      "server has been idle for a while.  "
+      "(default: 0, for no limit)" },
+  { "idle-timeout", IDLE_TIMEOUT_KEY, "SECONDS", 0,
+      "Let the server threads which have been idle for this long exit, "
+      "or never reap them if SECONDS is 0.  "
+      "When changed at runtime, this applies once the server has been "
+      "idle for a while.  "
+      "(default: 120)" },
+  { "max-slow-generators", MAX_SLOW_GENERATORS_KEY, "N", 0,
+      "Generate at most N of the [pid] files which require reading the "
+      "memory of the process, such as cmdline and environ, at the same "
+      "time.  "
+      "(default: 0, for no limit)" },
+  { "client-share", CLIENT_SHARE_KEY, "MS", 0,
+      "Let each user have contents generated on its behalf for at most "
+      "MS milliseconds per second on average.  Users over their share "
+      "get the contents already cached if possible, and their requests "
+      "are queued for a while otherwise.  When changed at runtime to or "
+      "from 0, this applies once the server has been idle for a while.  "
+      "(default: 0, for no limit)" },
+  { "trace-threshold", TRACE_THRESHOLD_KEY, "MS", 0,
+      "Record the generations of contents which take at least MS "
+      "milliseconds in the slow-requests file, or none if MS is 0.  "
+      "(default: 100)" },
+  { "slab-top", SLAB_TOP_KEY, "K", 0,
+      "List only the K biggest caches in the slabinfo-by-total and "
+      "slabinfo-by-reclaimable files, or all of them if K is 0.  "
+      "(default: 10)" },
+  { "slab-interval", SLAB_INTERVAL_KEY, "SECONDS", 0,
+      "Sample the kernel slab caches every SECONDS for the slabgrowth "
+      "file, or never if SECONDS is 0.  "
+      "(default: 60)" },
+  { "history-interval", HISTORY_INTERVAL_KEY, "SECONDS", 0,
+      "Sample the memory and load statistics every SECONDS for the "
+      "hosthistory and paging files and the pressure directory, or never "
+      "if SECONDS is 0.  "
+      "(default: 1)" },
+  { "pressure-threshold", PRESSURE_THRESHOLD_KEY, "PERCENT", 0,
+      "Consider that memory is under pressure when less than PERCENT "
+      "of it is free, for the pressure/memory file.  "
+      "(default: 5)" },
+  { "native-mounts", NATIVE_MOUNTS_KEY, NULL, 0,
+      "Generate the mounts file within procfs, rather than by starting "
+      "the /hurd/mtab translator.  "
+      "(default: off)" },
+  { "prewarm", PREWARM_KEY, NULL, 0,
+      "At startup, fill in advance the caches that the first clients "
+      "are likely to need.  "
+      "(default: off)" },
   { "nodev", NODEV_KEY, NULL, 0,
       "Ignored for compatibility with Linux' procfs." },
   { "noexec", NOEXEC_KEY, NULL, 0,
@@ -252,6 +435,39 @@ netfs_append_args (char **argz, size_t *argz_len)
   FOPT (opt_kernel_pid, OPT_KERNEL_PID,
         "--kernel-process=%d", opt_kernel_pid);
 
+  FOPT (opt_max_workers, OPT_MAX_WORKERS,
+        "--max-workers=%d", opt_max_workers);
+
+  FOPT (opt_idle_timeout, OPT_IDLE_TIMEOUT,
+        "--idle-timeout=%d", opt_idle_timeout);
+
+  FOPT (opt_max_slow_generators, OPT_MAX_SLOW_GENERATORS,
+        "--max-slow-generators=%d", opt_max_slow_generators);
+
+  FOPT (opt_client_share, OPT_CLIENT_SHARE,
+        "--client-share=%d", opt_client_share);
+
+  FOPT (opt_trace_threshold, OPT_TRACE_THRESHOLD,
+        "--trace-threshold=%d", opt_trace_threshold);
+
+  FOPT (opt_slab_top, OPT_SLAB_TOP,
+        "--slab-top=%d", opt_slab_top);
+
+  FOPT (opt_slab_interval, OPT_SLAB_INTERVAL,
+        "--slab-interval=%d", opt_slab_interval);
+
+  FOPT (opt_history_interval, OPT_HISTORY_INTERVAL,
+        "--history-interval=%d", opt_history_interval);
+
+  FOPT (opt_pressure_threshold, OPT_PRESSURE_THRESHOLD,
+        "--pressure-threshold=%d", opt_pressure_threshold);
+
+  FOPT (opt_native_mounts, OPT_NATIVE_MOUNTS,
+        "--native-mounts");
+
+  FOPT (opt_prewarm, OPT_PREWARM,
+        "--prewarm");
+
 #undef FOPT
 
   if (! err)
@@ -279,17 +495,91 @@ root_make_node (struct ps_context *pc, struct node **np)
   return 0;
 }
 
+/* Serve the request INP.  The interrupts and the notifications are not
+   counted as the first request.  */
+static int
+demuxer (mach_msg_header_t *inp, mach_msg_header_t *outp)
+{
+  if (! ports_interrupt_server_routine (inp)
+      && ! ports_notify_server_routine (inp))
+    prewarm_note_request ();
+
+  return netfs_demuxer (inp, outp);
+}
+
+/* Return how long the request INP should wait before being served, in
+   milliseconds, because its client is over its share.  */
+static int
+request_delay (mach_msg_header_t *inp)
+{
+  struct protid *cred;
+  int delay;
+
+  cred = ports_lookup_port (netfs_port_bucket, inp->msgh_local_port,
+			    netfs_protid_class);
+  if (! cred)
+    return 0;
+
+  delay = throttle_user_delay (cred->user);
+  ports_port_deref (cred);
+  return delay;
+}
+
+/* This replaces netfs_server_loop, so that the options are taken into
+   account.  With --max-workers or --client-share, the requests are served
+   by a pool of threads, bounded or not, which holds back the requests of
+   the clients over their share without using a thread for them.
+   Otherwise they are served by as many threads as libports creates.
+   Which is used and the idle timeout are read each time the threads are
+   started again after the server has been idle.  Like
+   netfs_server_loop, this exits once the server has shut down.  */
+static void
+server_loop (void)
+{
+  error_t err;
+
+  do
+    {
+      if (opt_max_workers > 0 || opt_client_share > 0)
+	workers_manage (netfs_port_bucket, demuxer,
+			opt_client_share > 0 ? request_delay : NULL,
+			&opt_max_workers, opt_idle_timeout * 1000,
+			SERVER_TIMEOUT);
+      else
+	ports_manage_port_operations_multithread (netfs_port_bucket, demuxer,
+						  opt_idle_timeout * 1000,
+						  SERVER_TIMEOUT, 0);
+      err = netfs_shutdown (0);
+    }
+  while (err);
+
+  exit (0);
+}
+
 int main (int argc, char **argv)
 {
   struct ps_context *pc;
   mach_port_t bootstrap;
   error_t err;
 
+  prewarm_begin ();
+
   opt_clk_tck = OPT_CLK_TCK;
   opt_stat_mode = OPT_STAT_MODE;
   opt_fake_self = OPT_FAKE_SELF;
   opt_kernel_pid = OPT_KERNEL_PID;
   opt_anon_owner = OPT_ANON_OWNER;
+  opt_max_workers = OPT_MAX_WORKERS;
+  opt_idle_timeout = OPT_IDLE_TIMEOUT;
+  opt_max_slow_generators = OPT_MAX_SLOW_GENERATORS;
+  opt_client_share = OPT_CLIENT_SHARE;
+  opt_trace_threshold = OPT_TRACE_THRESHOLD;
+  opt_slab_top = OPT_SLAB_TOP;
+  opt_slab_interval = OPT_SLAB_INTERVAL;
+  opt_history_interval = OPT_HISTORY_INTERVAL;
+  opt_pressure_threshold = OPT_PRESSURE_THRESHOLD;
+  opt_native_mounts = OPT_NATIVE_MOUNTS;
+  opt_prewarm = OPT_PREWARM;
   err = argp_parse (&argp, argc, argv, 0, 0, 0);
   if (err)
     error (1, err, "Could not parse command line");
@@ -307,9 +597,25 @@ int main (int argc, char **argv)
   if (err)
     error (1, err, "Could not create the root node");
 
+  err = slabhist_start ();
+  if (err)
+    error (0, err, "Could not start sampling the slab caches");
+
+  err = hosthist_start ();
+  if (err)
+    error (0, err, "Could not start sampling the host statistics");
+
+  if (opt_prewarm)
+    {
+      err = prewarm_start (pc);
+      if (err)
+	error (0, err, "Could not start prewarming");
+    }
+
   netfs_startup (bootstrap, 0);
-  netfs_server_loop ();
+  prewarm_note_ready ();
+  server_loop ();
 
-  assert (0 /* netfs_server_loop returned after all */);
+  assert (0 /* server_loop returned after all */);
 }
 
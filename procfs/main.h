@@ -23,3 +23,14 @@ extern mode_t opt_stat_mode;
 extern pid_t opt_fake_self;
 extern pid_t opt_kernel_pid;
 extern uid_t opt_anon_owner;
+extern int opt_max_workers;
+extern int opt_idle_timeout;
+extern int opt_max_slow_generators;
+extern int opt_client_share;
+extern int opt_trace_threshold;
+extern int opt_slab_top;
+extern int opt_slab_interval;
+extern int opt_history_interval;
+extern int opt_pressure_threshold;
+extern int opt_native_mounts;
+extern int opt_prewarm;
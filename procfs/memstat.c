@@ -0,0 +1,110 @@
+/* Hurd /proc filesystem, accounting of our own memory usage.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+#include "procfs.h"
+#include "memstat.h"
+
+struct memstat
+{
+  const char *name;
+  long live;
+  long peak;
+
+  /* The number of allocations so far.  */
+  unsigned long allocs;
+};
+
+/* The counters are updated atomically, since they are shared by all the
+   threads and updated on every allocation.  */
+static struct memstat memstats[MEMSTAT_NUM_CATEGORIES] = {
+  [MEMSTAT_NODES] = { "nodes" },
+  [MEMSTAT_CONTENTS] = { "contents" },
+  [MEMSTAT_DIRS] = { "dirs" },
+  [MEMSTAT_PROC_STAT] = { "proc_stat" },
+  [MEMSTAT_PS_BUFFERS] = { "ps_buffers" },
+  [MEMSTAT_INDEX] = { "index" },
+  [MEMSTAT_SNAPSHOTS] = { "snapshots" },
+  [MEMSTAT_SLABHIST] = { "slabhist" },
+  [MEMSTAT_MOUNTS] = { "mounts" },
+};
+
+void
+memstat_add (enum memstat_category category, ssize_t size)
+{
+  struct memstat *m = &memstats[category];
+  long live, peak;
+
+  live = __atomic_add_fetch (&m->live, size, __ATOMIC_RELAXED);
+
+  peak = __atomic_load_n (&m->peak, __ATOMIC_RELAXED);
+  while (live > peak
+	 && ! __atomic_compare_exchange_n (&m->peak, &peak, live, 1,
+					   __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED))
+    ;
+}
+
+void
+memstat_alloc (enum memstat_category category, size_t size)
+{
+  __atomic_add_fetch (&memstats[category].allocs, 1, __ATOMIC_RELAXED);
+  memstat_add (category, size);
+}
+
+void
+memstat_free (enum memstat_category category, size_t size)
+{
+  memstat_add (category, - (ssize_t) size);
+}
+
+static error_t
+memstat_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  size_t len;
+  FILE *m;
+  int i;
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  fprintf (m, "%-12s %12s %12s %12s\n", "category", "live", "peak",
+	   "allocs");
+  for (i = 0; i < MEMSTAT_NUM_CATEGORIES; i++)
+    fprintf (m, "%-12s %12ld %12ld %12lu\n", memstats[i].name,
+	     __atomic_load_n (&memstats[i].live, __ATOMIC_RELAXED),
+	     __atomic_load_n (&memstats[i].peak, __ATOMIC_RELAXED),
+	     __atomic_load_n (&memstats[i].allocs, __ATOMIC_RELAXED));
+
+  fclose (m);
+  *contents_len = len;
+  return 0;
+}
+
+struct node *
+memstat_make_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = memstat_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, NULL);
+}
@@ -0,0 +1,84 @@
+/* Hurd /proc filesystem, accounting of our own memory usage.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <sys/types.h>
+
+/* The kinds of memory we keep track of.  Every buffer which outlives the
+   request which allocated it is accounted for, with the size requested
+   from malloc(), except that of the contents, which is the actual size of
+   their buffer.  Not counted are the temporary buffers which are freed
+   before the request completes, the structures of the libraries, such as
+   the users duplicated by libiohelp, and the fixed-size tables of the
+   trace, hosthist and the procindex change log, which are static.  */
+enum memstat_category
+{
+  /* The node and netnode structures, which are two allocations.  */
+  MEMSTAT_NODES,
+
+  /* The contents cached by the nodes and the views of their users, as
+     well as the buffers which rootdir keeps for the static files and the
+     kernel command line.  The contents which the nodes do not own, such
+     as those of the static files or those of cmdline and environ which
+     point into the libps buffers, only count for the structure referring
+     to them.  */
+  MEMSTAT_CONTENTS,
+
+  /* The hooks of the nodes: those of the procfs_dir, dircat, process,
+     procindex, query and snapshot nodes and of the process files, as well
+     as the filters of the queries.  */
+  MEMSTAT_DIRS,
+
+  /* The proc_stat structures of the process directories, not including
+     the buffers they refer to.  */
+  MEMSTAT_PROC_STAT,
+
+  /* The argument and environment buffers held by these proc_stat
+     structures.  libps allocates them, so they are not counted as
+     allocations of ours.  */
+  MEMSTAT_PS_BUFFERS,
+
+  /* The table of procindex and the command names it holds.  */
+  MEMSTAT_INDEX,
+
+  /* The images of the snapshot directories.  */
+  MEMSTAT_SNAPSHOTS,
+
+  /* The table of the slab caches sampled by slabhist.  */
+  MEMSTAT_SLABHIST,
+
+  /* The mount table cached by mounts.  */
+  MEMSTAT_MOUNTS,
+
+  MEMSTAT_NUM_CATEGORIES
+};
+
+/* Account for one allocation of SIZE bytes in CATEGORY.  */
+void memstat_alloc (enum memstat_category category, size_t size);
+
+/* Account for the release of SIZE bytes allocated in CATEGORY.  */
+void memstat_free (enum memstat_category category, size_t size);
+
+/* Account for SIZE more bytes in CATEGORY, or fewer if SIZE is negative,
+   without counting an allocation.  This is for memory held on our behalf
+   but allocated by someone else.  */
+void memstat_add (enum memstat_category category, ssize_t size);
+
+/* Create a file listing the current and peak usage of each category, and
+   the number of allocations made so far.  */
+struct node *memstat_make_node (void);
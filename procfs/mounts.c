@@ -0,0 +1,513 @@
+/* Hurd /proc filesystem, native generation of the mounts file.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <mach.h>
+#include <hurd.h>
+#include <hurd/fsys.h>
+#include <hurd/netfs.h>
+#include <argz.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "procfs.h"
+#include "mounts.h"
+#include "memstat.h"
+#include "main.h"
+
+/* By default, the mounts file is a passive translator which starts
+   /hurd/mtab on first access.  With --native-mounts, the table is built
+   here instead, by walking the tree of the active translators from the
+   root filesystem, in the same way as mtab does.
+
+   The table is cached between reads, and served as is for MOUNTS_MAX_AGE
+   seconds after it was last checked.  The check walks the tree to list
+   the mount points only, which takes one RPC per filesystem, and the
+   table is generated again when this list changes.  It is also generated
+   again when it is older than MOUNTS_MAX_TABLE_AGE seconds, so that the
+   changes of options are eventually noticed as well, in which case the
+   same walk gives the mount points.
+
+   A translator which does not answer must not hold up the readers
+   forever, so each walk has a deadline, past which its RPCs are
+   cancelled and the cached table is served instead, if there is one.
+   The walks are made without holding mounts_lock, so that the other
+   readers can still be served the cached table meanwhile, and only one
+   reader walks the tree at a time.  */
+
+/* How long the table is served without checking the mount points, in
+   seconds.  */
+#define MOUNTS_MAX_AGE 10
+
+/* How long the table is reused while the mount points stay the same, in
+   seconds.  */
+#define MOUNTS_MAX_TABLE_AGE 60
+
+/* How deep the translators can be stacked below the root filesystem.
+   This prevents a translator which lists itself as its own child from
+   sending us into an infinite loop.  */
+#define MOUNTS_MAX_DEPTH 32
+
+/* How long a walk of the translators can take, in seconds.  */
+#define MOUNTS_TIMEOUT 5
+
+static pthread_mutex_t mounts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The cached table, the list of the mount points it was generated from,
+   when it was generated and when the mount points were last checked.  */
+static char *mounts_table;
+static size_t mounts_table_len;
+static char *mounts_points;
+static size_t mounts_points_len;
+static time_t mounts_time;
+static time_t mounts_checked;
+
+/* Return whether DEADLINE has passed.  */
+static int
+mounts_expired (const struct timespec *deadline)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  return now.tv_sec > deadline->tv_sec
+    || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/* The watchdog is a single thread, started on the first walk, which
+   cancels the RPCs of the walk in progress once its deadline has passed.
+   The fsys RPCs are interruptible, so the one in progress then fails
+   with EINTR, and the walk stops.  The walks are serialized by
+   mounts_walk_lock, so there is at most one to watch.  */
+static pthread_mutex_t mounts_walk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mounts_watchdog_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t mounts_watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mounts_watchdog_cond = PTHREAD_COND_INITIALIZER;
+static error_t mounts_watchdog_err;
+
+/* The thread walking the translators and its deadline, if WATCHING.  */
+static int mounts_watching;
+static thread_t mounts_watched;
+static struct timespec mounts_deadline;
+
+static void *
+mounts_watchdog_thread (void *arg)
+{
+  pthread_mutex_lock (&mounts_watchdog_lock);
+  for (;;)
+    {
+      if (! mounts_watching)
+	pthread_cond_wait (&mounts_watchdog_cond, &mounts_watchdog_lock);
+      else if (! mounts_expired (&mounts_deadline))
+	pthread_cond_timedwait (&mounts_watchdog_cond, &mounts_watchdog_lock,
+				&mounts_deadline);
+      else
+	{
+	  hurd_thread_cancel (mounts_watched);
+	  mounts_watching = 0;
+	}
+    }
+
+  return NULL;
+}
+
+static void
+mounts_watchdog_init (void)
+{
+  pthread_t thread;
+
+  mounts_watchdog_err = pthread_create (&thread, NULL,
+					mounts_watchdog_thread, NULL);
+  if (! mounts_watchdog_err)
+    pthread_detach (thread);
+}
+
+/* Start watching the current thread, with a deadline MOUNTS_TIMEOUT
+   seconds from now, which is stored in DEADLINE.  */
+static error_t
+mounts_watchdog_start (struct timespec *deadline)
+{
+  pthread_once (&mounts_watchdog_once, mounts_watchdog_init);
+  if (mounts_watchdog_err)
+    return mounts_watchdog_err;
+
+  clock_gettime (CLOCK_REALTIME, deadline);
+  deadline->tv_sec += MOUNTS_TIMEOUT;
+
+  pthread_mutex_lock (&mounts_watchdog_lock);
+  mounts_watched = mach_thread_self ();
+  mounts_deadline = *deadline;
+  mounts_watching = 1;
+  pthread_cond_signal (&mounts_watchdog_cond);
+  pthread_mutex_unlock (&mounts_watchdog_lock);
+
+  return 0;
+}
+
+/* Stop watching the current thread, and return whether DEADLINE has
+   passed.  */
+static int
+mounts_watchdog_stop (const struct timespec *deadline)
+{
+  pthread_mutex_lock (&mounts_watchdog_lock);
+  mounts_watching = 0;
+  mach_port_deallocate (mach_task_self (), mounts_watched);
+  pthread_mutex_unlock (&mounts_watchdog_lock);
+
+  /* The cancellation may have come in between two RPCs, in which case it
+     is still pending, and would make the next request of this thread
+     fail.  */
+  hurd_check_cancel ();
+
+  return mounts_expired (deadline);
+}
+
+/* Write STR to M, with the characters which would break the fields of
+   the table escaped as octal sequences, as Linux does.  */
+static void
+mounts_put_escaped (FILE *m, const char *str)
+{
+  for (; *str; str++)
+    if (strchr (" \t\n\\", *str))
+      fprintf (m, "\\%03o", (unsigned char) *str);
+    else
+      fputc (*str, m);
+}
+
+/* Return whether CONTROL is the control port of this very server.  */
+static int
+mounts_is_self (fsys_t control)
+{
+  void *pi;
+
+  pi = ports_lookup_port (netfs_port_bucket, control, netfs_control_class);
+  if (! pi)
+    return 0;
+
+  ports_port_deref (pi);
+  return 1;
+}
+
+/* Write to M the line for the filesystem served by CONTROL and mounted at
+   PATH.  Translators which don't report a source are not filesystems, and
+   are left out.  */
+static void
+mounts_put_entry (FILE *m, fsys_t control, const char *path)
+{
+  string_t source;
+  char *argz, *opt, *type;
+  mach_msg_type_number_t argz_len;
+  size_t len;
+  int self, first;
+
+  /* Querying ourselves through RPCs could wait forever for a worker when
+     --max-workers is reached, so answer directly.  */
+  self = mounts_is_self (control);
+
+  argz = NULL;
+  argz_len = 0;
+  if (self)
+    {
+      strcpy (source, "proc");
+      len = 0;
+      if (netfs_append_args (&argz, &len))
+	return;
+      argz_len = len;
+    }
+  else if (fsys_get_source (control, source)
+	   || fsys_get_options (control, &argz, &argz_len))
+    return;
+
+  /* The first element of the options is the file name of the
+     translator.  */
+  if (self)
+    type = "procfs";
+  else if (argz_len)
+    {
+      type = strrchr (argz, '/');
+      type = type ? type + 1 : argz;
+    }
+  else
+    type = "none";
+
+  mounts_put_escaped (m, source);
+  fputc (' ', m);
+  mounts_put_escaped (m, path);
+  fputc (' ', m);
+  mounts_put_escaped (m, type);
+  fputc (' ', m);
+
+  first = 1;
+  for (opt = argz_next (argz, argz_len, self ? NULL : argz);
+       opt;
+       opt = argz_next (argz, argz_len, opt))
+    {
+      if (! first)
+	fputc (',', m);
+      mounts_put_escaped (m, opt[0] == '-' && opt[1] == '-' ? opt + 2 : opt);
+      first = 0;
+    }
+  if (first)
+    fputs ("defaults", m);
+
+  fputs (" 0 0\n", m);
+
+  if (self)
+    free (argz);
+  else
+    vm_deallocate (mach_task_self (), (vm_address_t) argz, argz_len);
+}
+
+/* Write to POINTS the mount points of the filesystem served by CONTROL,
+   which is mounted at PATH, and of those stacked below it, one per line,
+   and their entries to TABLE unless it is NULL.  Nothing more is listed
+   once DEADLINE has passed.  */
+static void
+mounts_walk (FILE *points, FILE *table, fsys_t control, const char *path,
+	     int depth, const struct timespec *deadline)
+{
+  char *children, *child, *child_path;
+  mach_msg_type_number_t children_len, num_controls, i;
+  mach_port_t *controls;
+
+  if (mounts_expired (deadline))
+    return;
+
+  fprintf (points, "%s\n", path);
+  if (table)
+    mounts_put_entry (table, control, path);
+
+  /* The children of this server are only the mounts translator.  */
+  if (depth >= MOUNTS_MAX_DEPTH || mounts_is_self (control)
+      || mounts_expired (deadline))
+    return;
+
+  children = NULL;
+  children_len = 0;
+  controls = NULL;
+  num_controls = 0;
+  if (fsys_get_children (control, &children, &children_len,
+			 &controls, &num_controls))
+    return;
+
+  for (child = children, i = 0;
+       child && i < num_controls;
+       child = argz_next (children, children_len, child), i++)
+    {
+      if (! MACH_PORT_VALID (controls[i]))
+	continue;
+
+      if (asprintf (&child_path, "%s/%s",
+		    strcmp (path, "/") ? path : "", child) >= 0)
+	{
+	  mounts_walk (points, table, controls[i], child_path, depth + 1,
+		       deadline);
+	  free (child_path);
+	}
+
+      mach_port_deallocate (mach_task_self (), controls[i]);
+    }
+
+  vm_deallocate (mach_task_self (), (vm_address_t) children, children_len);
+  vm_deallocate (mach_task_self (), (vm_address_t) controls,
+		 num_controls * sizeof *controls);
+}
+
+/* Walk the translators from the root filesystem, and list their mount
+   points into the newly malloced POINTS, and their entries into TABLE
+   unless it is NULL.  Fail with ETIMEDOUT if this takes longer than
+   MOUNTS_TIMEOUT seconds.  Must be called with mounts_walk_lock held.  */
+static error_t
+mounts_generate (char **points, size_t *points_len,
+		 char **table, size_t *table_len)
+{
+  struct timespec deadline;
+  fsys_t control;
+  file_t root;
+  FILE *p, *t = NULL;
+  error_t err;
+
+  p = open_memstream (points, points_len);
+  if (table)
+    t = open_memstream (table, table_len);
+  if (! p || (table && ! t))
+    {
+      err = ENOMEM;
+      goto out;
+    }
+
+  err = mounts_watchdog_start (&deadline);
+  if (err)
+    goto out;
+
+  root = getcrdir ();
+  err = file_getcontrol (root, &control);
+  mach_port_deallocate (mach_task_self (), root);
+  if (! err)
+    {
+      mounts_walk (p, t, control, "/", 0, &deadline);
+      mach_port_deallocate (mach_task_self (), control);
+    }
+
+  if (mounts_watchdog_stop (&deadline))
+    err = ETIMEDOUT;
+
+out:
+  if (p)
+    {
+      fclose (p);
+      if (err)
+	free (*points);
+    }
+  if (t)
+    {
+      fclose (t);
+      if (err)
+	free (*table);
+    }
+  return err;
+}
+
+/* Check the mount points and generate the table again if needed, at time
+   NOW.  Must be called with mounts_walk_lock held.  */
+static error_t
+mounts_update (time_t now)
+{
+  char *points, *table;
+  size_t points_len, table_len;
+  int fresh, old, changed;
+  error_t err;
+
+  pthread_mutex_lock (&mounts_lock);
+  fresh = mounts_table && now - mounts_checked < MOUNTS_MAX_AGE;
+  old = ! mounts_table || now - mounts_time >= MOUNTS_MAX_TABLE_AGE;
+  pthread_mutex_unlock (&mounts_lock);
+
+  /* Another reader may have just updated the table.  */
+  if (fresh)
+    return 0;
+
+  if (old)
+    err = mounts_generate (&points, &points_len, &table, &table_len);
+  else
+    {
+      err = mounts_generate (&points, &points_len, NULL, NULL);
+      if (err)
+	return err;
+
+      pthread_mutex_lock (&mounts_lock);
+      changed = points_len != mounts_points_len
+	|| memcmp (points, mounts_points, points_len);
+      if (! changed)
+	mounts_checked = now;
+      pthread_mutex_unlock (&mounts_lock);
+
+      free (points);
+      if (! changed)
+	return 0;
+
+      err = mounts_generate (&points, &points_len, &table, &table_len);
+    }
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&mounts_lock);
+  if (mounts_table)
+    {
+      memstat_free (MEMSTAT_MOUNTS, mounts_table_len);
+      memstat_free (MEMSTAT_MOUNTS, mounts_points_len);
+    }
+  free (mounts_table);
+  free (mounts_points);
+  mounts_table = table;
+  mounts_table_len = table_len;
+  mounts_points = points;
+  mounts_points_len = points_len;
+  memstat_alloc (MEMSTAT_MOUNTS, table_len);
+  memstat_alloc (MEMSTAT_MOUNTS, points_len);
+  mounts_time = mounts_checked = now;
+  pthread_mutex_unlock (&mounts_lock);
+
+  return 0;
+}
+
+static error_t
+mounts_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  struct timespec now;
+  int fresh, cached;
+  error_t err = 0;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock (&mounts_lock);
+  cached = mounts_table != NULL;
+  fresh = cached && now.tv_sec - mounts_checked < MOUNTS_MAX_AGE;
+  pthread_mutex_unlock (&mounts_lock);
+
+  /* While another reader walks the tree, serve the cached table if there
+     is one, rather than wait for the walk to end.  */
+  if (! fresh
+      && (cached ? ! pthread_mutex_trylock (&mounts_walk_lock)
+	  : ! pthread_mutex_lock (&mounts_walk_lock)))
+    {
+      err = mounts_update (now.tv_sec);
+
+      /* Don't retry a walk which failed before the next check either,
+	 since a translator which doesn't answer would make it wait for
+	 the deadline again.  */
+      if (err)
+	{
+	  pthread_mutex_lock (&mounts_lock);
+	  mounts_checked = now.tv_sec;
+	  pthread_mutex_unlock (&mounts_lock);
+	}
+      pthread_mutex_unlock (&mounts_walk_lock);
+    }
+
+  /* Serve the cached table when the walk failed, as long as there is
+     one.  */
+  pthread_mutex_lock (&mounts_lock);
+  if (! mounts_table)
+    {
+      pthread_mutex_unlock (&mounts_lock);
+      return err ?: EIO;
+    }
+
+  *contents = malloc (mounts_table_len ?: 1);
+  if (*contents)
+    {
+      memcpy (*contents, mounts_table, mounts_table_len);
+      *contents_len = mounts_table_len;
+    }
+
+  pthread_mutex_unlock (&mounts_lock);
+  return *contents ? 0 : ENOMEM;
+}
+
+struct node *
+mounts_make_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = mounts_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, NULL);
+}
@@ -26,6 +26,7 @@
 #include <sys/statvfs.h>
 #include <unistd.h>
 #include "procfs.h"
+#include "throttle.h"
 
 #define PROCFS_SERVER_NAME "procfs"
 #define PROCFS_SERVER_VERSION "0.1.0"
@@ -45,6 +46,20 @@ char *netfs_server_version = PROCFS_SERVER_VERSION;
 /* Maximum number of symlinks to follow before returning ELOOP. */
 int netfs_maxsymlinks = PROCFS_MAXSYMLINKS;
 
+/* Apply the admission control to CRED, which becomes the client of the
+   current thread, before the contents of the locked node NP are used.
+   Return nonzero if the contents may be regenerated.  The requests of the
+   clients over their share have already been delayed before being given
+   a thread (see workers_manage), and if they are still over it, they are
+   served the cached contents when there are some.  The caller must call
+   throttle_client_end() once done with the contents.  */
+static int
+admit (struct iouser *cred, struct node *np)
+{
+  throttle_client_begin (cred);
+  return ! throttle_client_delay () || ! procfs_has_contents (np);
+}
+
 /* The user must define this function.  Make sure that NP->nn_stat is
    filled with the most current information.  CRED identifies the user
    responsible for the operation. NP is locked.  */
@@ -54,6 +69,17 @@ error_t netfs_validate_stat (struct node *np, struct iouser *cred)
   ssize_t contents_len;
   error_t err;
 
+  /* Report a size clients can use to allocate their buffer, and a
+     modification time telling them whether to read the file again.  The
+     generators are not run here, since libnetfs calls this on every
+     lookup and open, so both come from the information at hand.  */
+  if (S_ISREG (np->nn_stat.st_mode))
+    {
+      procfs_update_mtime (np);
+      np->nn_stat.st_size = procfs_get_size (np);
+      return 0;
+    }
+
   /* Only symlinks need to have their size filled, before a read is
      attempted.  */
   if (! S_ISLNK (np->nn_stat.st_mode))
@@ -78,10 +104,9 @@ error_t netfs_attempt_read (struct iouser *cred, struct node *np,
   ssize_t contents_len;
   error_t err;
 
-  if (offset == 0)
-    procfs_refresh (np);
-
-  err = procfs_get_contents (np, &contents, &contents_len);
+  err = procfs_get_user_contents (np, cred, admit (cred, np) && offset == 0,
+				  &contents, &contents_len);
+  throttle_client_end ();
   if (err)
     return err;
 
@@ -116,11 +141,13 @@ error_t netfs_attempt_readlink (struct iouser *user, struct node *np,
 }
 
 /* Helper function for netfs_get_dirents() below.  CONTENTS is an argz
-   vector of directory entry names, as returned by procfs_get_contents().
-   Convert at most NENTRIES of them to dirent structures, put them in
-   DATA (if not NULL), write the number of entries processed in *AMT and
-   return the required/used space in DATACNT.  */
-static int putentries (char *contents, size_t contents_len, int nentries,
+   vector of directory entry names, as returned by procfs_get_contents()
+   for the directory DIR.  Convert at most NENTRIES of them to dirent
+   structures, put them in DATA (if not NULL), write the number of
+   entries processed in *AMT and return the required/used space in
+   DATACNT.  */
+static int putentries (struct node *dir,
+		       char *contents, size_t contents_len, int nentries,
 		       char *data, mach_msg_type_number_t *datacnt)
 {
   int i;
@@ -134,10 +161,10 @@ static int putentries (char *contents, size_t contents_len, int nentries,
       if (data)
         {
 	  struct dirent *d = (struct dirent *) (data + *datacnt);
-	  d->d_fileno = 42; /* XXX */
+	  d->d_fileno = procfs_make_ino (dir, contents);
 	  d->d_namlen = namlen;
 	  d->d_reclen = reclen;
-	  d->d_type = DT_UNKNOWN;
+	  d->d_type = procfs_get_dirent_type (dir, contents);
 	  strcpy (d->d_name, contents);
 	}
 
@@ -164,10 +191,9 @@ error_t netfs_get_dirents (struct iouser *cred, struct node *dir,
   ssize_t contents_len;
   error_t err;
 
-  if (entry == 0)
-    procfs_refresh (dir);
- 
-  err = procfs_get_contents (dir, &contents, &contents_len);
+  err = procfs_get_user_contents (dir, cred, admit (cred, dir) && entry == 0,
+				  &contents, &contents_len);
+  throttle_client_end ();
   if (err)
     return err;
 
@@ -183,7 +209,7 @@ error_t netfs_get_dirents (struct iouser *cred, struct node *dir,
     }
 
   /* Allocate a buffer if necessary. */
-  putentries (contents, contents_len, nentries, NULL, datacnt);
+  putentries (dir, contents, contents_len, nentries, NULL, datacnt);
   if (bufsize < *datacnt)
     {
       char *n = mmap (0, *datacnt, PROT_READ | PROT_WRITE, MAP_ANONYMOUS, 0, 0);
@@ -194,7 +220,7 @@ error_t netfs_get_dirents (struct iouser *cred, struct node *dir,
     }
 
   /* Do the actual conversion. */
-  *amt = putentries (contents, contents_len, nentries, *data, datacnt);
+  *amt = putentries (dir, contents, contents_len, nentries, *data, datacnt);
 
   return 0;
 }
@@ -209,7 +235,9 @@ error_t netfs_attempt_lookup (struct iouser *user, struct node *dir,
 {
   error_t err;
 
+  throttle_client_begin (user);
   err = procfs_lookup (dir, name, np);
+  throttle_client_end ();
   pthread_mutex_unlock (&dir->lock);
 
   if (! err)
@@ -222,6 +250,7 @@ error_t netfs_attempt_lookup (struct iouser *user, struct node *dir,
    free all its associated storage. */
 void netfs_node_norefs (struct node *np)
 {
+  procfs_drop_weak_ref (np);
   pthread_spin_unlock (&netfs_node_refcnt_lock);
 
   procfs_cleanup (np);
@@ -351,7 +380,9 @@ error_t netfs_attempt_utimes (struct iouser *cred, struct node *np,
 error_t netfs_attempt_set_size (struct iouser *cred, struct node *np,
 				loff_t size)
 {
-  return EROFS;
+  /* Writable files have no persistent contents, so there is nothing to
+     truncate.  This allows them to be opened with O_TRUNC.  */
+  return procfs_writable (np) ? 0 : EROFS;
 }
 
 /* The user must define this function.  This should attempt to fetch
@@ -455,7 +486,7 @@ error_t netfs_attempt_create_file (struct iouser *user, struct node *dir,
 error_t netfs_attempt_write (struct iouser *cred, struct node *np,
 			     loff_t offset, size_t *len, void *data)
 {
-  return EROFS;
+  return procfs_write (np, cred, data, len);
 }
 
 
@@ -0,0 +1,155 @@
+/* Hurd /proc filesystem, prewarming and startup metrics.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "procfs.h"
+#include "rootdir.h"
+#include "procindex.h"
+#include "prewarm.h"
+
+/* procfs is usually started on demand as a passive translator, so the
+   client which triggered it waits for the first request to be served.
+   With --prewarm, a thread fills the caches which outlive the requests
+   while the server is being started: it generates the static files of
+   the root directory, fetches the boot time, the basic information about
+   the host and the command line of the kernel, and retrieves the list of
+   the processes, which the first listing of the root directory uses.  The
+   files which are generated again for each read are left alone, since
+   their contents would not last until the first client reads them.
+
+   The procfs-startup file tells how long after the beginning of main()
+   the server was ready, the prewarming was done and the first request
+   was served, in milliseconds.  */
+
+static struct timespec prewarm_start_time;
+
+/* The milestones, in microseconds since prewarm_start_time, or -1 until
+   they are reached.  */
+static long long prewarm_ready = -1;
+static long long prewarm_done = -1;
+static long long prewarm_first_request = -1;
+
+static long long
+prewarm_usecs (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - prewarm_start_time.tv_sec) * 1000000LL
+    + (now.tv_nsec - prewarm_start_time.tv_nsec) / 1000;
+}
+
+void
+prewarm_begin (void)
+{
+  clock_gettime (CLOCK_MONOTONIC, &prewarm_start_time);
+}
+
+void
+prewarm_note_ready (void)
+{
+  __atomic_store_n (&prewarm_ready, prewarm_usecs (), __ATOMIC_RELAXED);
+}
+
+void
+prewarm_note_request (void)
+{
+  long long unset = -1;
+
+  /* This is called for every request, so avoid the clock when possible.  */
+  if (__atomic_load_n (&prewarm_first_request, __ATOMIC_RELAXED) >= 0)
+    return;
+
+  __atomic_compare_exchange_n (&prewarm_first_request, &unset,
+			       prewarm_usecs (), 0,
+			       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void *
+prewarm_thread (void *arg)
+{
+  struct ps_context *pc = arg;
+
+  /* Listing the root directory is the most likely first request.  */
+  procindex_prewarm (pc);
+  rootdir_prewarm (pc);
+
+  __atomic_store_n (&prewarm_done, prewarm_usecs (), __ATOMIC_RELAXED);
+  return NULL;
+}
+
+error_t
+prewarm_start (struct ps_context *pc)
+{
+  pthread_t thread;
+  error_t err;
+
+  err = pthread_create (&thread, NULL, prewarm_thread, pc);
+  if (err)
+    return err;
+
+  pthread_detach (thread);
+  return 0;
+}
+
+
+/* The procfs-startup file */
+
+static void
+prewarm_put (FILE *m, const char *label, long long *usecs)
+{
+  long long v = __atomic_load_n (usecs, __ATOMIC_RELAXED);
+
+  if (v < 0)
+    fprintf (m, "%-14s %12s\n", label, "-");
+  else
+    fprintf (m, "%-14s %12.3f\n", label, v / 1000.);
+}
+
+static error_t
+prewarm_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  size_t len;
+  FILE *m;
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  prewarm_put (m, "ready", &prewarm_ready);
+  prewarm_put (m, "prewarmed", &prewarm_done);
+  prewarm_put (m, "first-request", &prewarm_first_request);
+
+  fclose (m);
+  *contents_len = len;
+  return 0;
+}
+
+struct node *
+prewarm_make_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = prewarm_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, NULL);
+}
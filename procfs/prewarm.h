@@ -0,0 +1,37 @@
+/* Hurd /proc filesystem, prewarming and startup metrics.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <ps.h>
+
+/* Record the beginning of the startup.  This should be called first
+   thing in main().  */
+void prewarm_begin (void);
+
+/* Record that the server is ready to serve requests.  */
+void prewarm_note_ready (void);
+
+/* Record that a request is being served.  Only the first one counts.  */
+void prewarm_note_request (void);
+
+/* Start a thread filling in advance the caches that the first clients
+   are likely to need, using the libps context PC.  */
+error_t prewarm_start (struct ps_context *pc);
+
+/* Create a file listing the startup milestones.  */
+struct node *prewarm_make_node (void);
@@ -20,6 +20,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
 #include <hurd/process.h>
 #include <hurd/resource.h>
 #include <mach/vm_param.h>
@@ -28,6 +31,9 @@
 #include "procfs_dir.h"
 #include "process.h"
 #include "main.h"
+#include "throttle.h"
+#include "trace.h"
+#include "memstat.h"
 
 /* This module implements the process directories and the files they
    contain.  A libps proc_stat structure is created for each process
@@ -37,13 +43,19 @@
    of information (ie. libps flags) it needs, and what function should
    be used to generate the file's contents.
 
+   The proc_stat structure is shared by all the files of a process
+   directory, and is protected by a lock in the process_dir structure
+   which serves as the directory hook.  Since the argument vector and
+   the environment can be quite large, they are released as soon as no
+   file is using them anymore, and fetched again when needed.
+
    The content generators are defined first, followed by glue logic and
    entry table.  */
 
 
 /* Helper functions */
 
-static char state_char (struct proc_stat *ps)
+char state_char (struct proc_stat *ps)
 {
   int i;
 
@@ -75,23 +87,39 @@ static const char *state_string (struct proc_stat *ps)
   return "? (unknown)";
 }
 
-static long long int timeval_jiffies (time_value_t tv)
+long long int timeval_jiffies (time_value_t tv)
 {
   double secs = tv.seconds * 1000000. + tv.microseconds;
   return secs * opt_clk_tck / 1000000.;
 }
 
-static const char *args_filename (const char *name)
+const char *args_filename (const char *name)
 {
   char *sp = strrchr (name, '/');
   return sp != NULL && *(sp + 1) != '\0' ? sp + 1 : name;
 }
 
-static int args_filename_length (const char *name)
+int args_filename_length (const char *name)
 {
   return strchrnul (name, ' ') - name;
 }
 
+/* Command names longer than this are truncated in stat and status, so
+   that the size of these files can be bounded without knowing the name.
+   Linux truncates them to 15 characters.  */
+#define PROCESS_NAME_MAX 255
+
+/* The length of the command name FN, as printed in stat and status.  */
+static int
+process_name_length (const char *fn)
+{
+  int len = args_filename_length (fn);
+  return len < PROCESS_NAME_MAX ? len : PROCESS_NAME_MAX;
+}
+
+/* Upper bound on the length of any number printed by the generators.  */
+#define NUMBER_STR_SIZE (3 * sizeof (long long int) + 1)
+
 /* Actual content generators */
 
 static ssize_t
@@ -101,6 +129,18 @@ process_file_gc_cmdline (struct proc_stat *ps, char **contents)
   return proc_stat_args_len(ps);
 }
 
+/* The argument vector and environment are only known while they are in
+   use, in which case they are also what the next read returns.  They may
+   have changed otherwise, so there is no estimate.  */
+static ssize_t
+process_file_size_cmdline (struct proc_stat *ps)
+{
+  if (! (proc_stat_flags (ps) & PSTAT_ARGS))
+    return -1;
+
+  return proc_stat_args_len (ps);
+}
+
 static ssize_t
 process_file_gc_environ (struct proc_stat *ps, char **contents)
 {
@@ -108,6 +148,15 @@ process_file_gc_environ (struct proc_stat *ps, char **contents)
   return proc_stat_env_len(ps);
 }
 
+static ssize_t
+process_file_size_environ (struct proc_stat *ps)
+{
+  if (! (proc_stat_flags (ps) & PSTAT_ENV))
+    return -1;
+
+  return proc_stat_env_len (ps);
+}
+
 static ssize_t
 process_file_gc_stat (struct proc_stat *ps, char **contents)
 {
@@ -158,7 +207,7 @@ process_file_gc_stat (struct proc_stat *ps, char **contents)
       "%u %u "			/* RT priority and policy */
       "%llu "			/* aggregated block I/O delay */
       "\n",
-      proc_stat_pid (ps), args_filename_length (fn), fn, state_char (ps),
+      proc_stat_pid (ps), process_name_length (fn), fn, state_char (ps),
       pi->ppid, pi->pgrp, pi->session,
       0, 0,		/* no such thing as a major:minor for ctty */
       0,		/* no such thing as CLONE_* flags on Hurd */
@@ -184,6 +233,15 @@ process_file_gc_stat (struct proc_stat *ps, char **contents)
       0LL);
 }
 
+/* The stat file has 42 fields separated by spaces, one of which is the
+   command name within parentheses, and the others are numbers or single
+   characters.  */
+static ssize_t
+process_file_size_stat (struct proc_stat *ps)
+{
+  return 41 * (NUMBER_STR_SIZE + 1) + PROCESS_NAME_MAX + 3;
+}
+
 static ssize_t
 process_file_gc_statm (struct proc_stat *ps, char **contents)
 {
@@ -195,6 +253,12 @@ process_file_gc_statm (struct proc_stat *ps, char **contents)
       tbi->resident_size / sysconf(_SC_PAGE_SIZE));
 }
 
+static ssize_t
+process_file_size_statm (struct proc_stat *ps)
+{
+  return 2 * NUMBER_STR_SIZE + sizeof " 0 0 0 0 0\n";
+}
+
 static ssize_t
 process_file_gc_status (struct proc_stat *ps, char **contents)
 {
@@ -213,7 +277,7 @@ process_file_gc_status (struct proc_stat *ps, char **contents)
       "VmRSS:\t%8u kB\n"
       "VmHWM:\t%8u kB\n" /* ie. resident peak */
       "Threads:\t%u\n",
-      args_filename_length (fn), fn,
+      process_name_length (fn), fn,
       state_string (ps),
       proc_stat_pid (ps), /* XXX will need more work for threads */
       proc_stat_pid (ps),
@@ -229,7 +293,138 @@ process_file_gc_status (struct proc_stat *ps, char **contents)
       proc_stat_num_threads (ps));
 }
 
+/* Besides the command name and the state string, the status file has
+   less than 140 characters worth of labels and separators, and 12
+   numbers.  */
+static ssize_t
+process_file_size_status (struct proc_stat *ps)
+{
+  return 140 + 12 * NUMBER_STR_SIZE + PROCESS_NAME_MAX
+    + strlen ("D (disk sleep)");
+}
+
 
+/* Shared process data. */
+
+/* The proc_stat information which we release after use.  */
+#define PROCESS_TRANSIENT_FLAGS (PSTAT_ARGS | PSTAT_ENV)
+
+/* This is the hook of the process directories, and is shared by the
+   corresponding file nodes.  */
+struct process_dir
+{
+  struct proc_stat *ps;
+  pthread_mutex_t lock;
+
+  /* The number of files whose cached contents point directly into the
+     argument vector and environment of PS, respectively.  */
+  int args_users;
+  int env_users;
+
+  /* The creation time of the process, once fetched.  */
+  int start_known;
+  struct timespec start;
+};
+
+/* Take note that the cached contents of a file point into the
+   PROCESS_TRANSIENT_FLAGS part of FLAGS.  DIR must be locked.  */
+static void
+process_dir_hold (struct process_dir *dir, ps_flags_t flags)
+{
+  if (flags & PSTAT_ARGS)
+    dir->args_users++;
+  if (flags & PSTAT_ENV)
+    dir->env_users++;
+}
+
+/* Release the argument vector and environment information designated
+   by FLAGS, unless they are still in use.  They will be fetched again
+   by the next proc_stat_set_flags() call needing them.  libps does not
+   provide a way to do this, so we free the data ourselves the same way
+   _proc_stat_free() does.  DIR must be locked.  */
+static void
+process_dir_release (struct process_dir *dir, ps_flags_t flags)
+{
+  struct proc_stat *ps = dir->ps;
+
+  flags &= proc_stat_flags (ps);
+
+  if ((flags & PSTAT_ARGS) && ! dir->args_users)
+    {
+      if (ps->args && ps->args_len > 0)
+	{
+	  memstat_add (MEMSTAT_PS_BUFFERS, - (ssize_t) ps->args_len);
+	  if (ps->args_vm_alloced)
+	    vm_deallocate (mach_task_self (),
+			   (vm_address_t) ps->args, ps->args_len);
+	  else
+	    free (ps->args);
+	}
+      ps->args = NULL;
+      ps->args_len = 0;
+      ps->flags &= ~PSTAT_ARGS;
+    }
+
+  if ((flags & PSTAT_ENV) && ! dir->env_users)
+    {
+      if (ps->env && ps->env_len > 0)
+	{
+	  memstat_add (MEMSTAT_PS_BUFFERS, - (ssize_t) ps->env_len);
+	  if (ps->env_vm_alloced)
+	    vm_deallocate (mach_task_self (),
+			   (vm_address_t) ps->env, ps->env_len);
+	  else
+	    free (ps->env);
+	}
+      ps->env = NULL;
+      ps->env_len = 0;
+      ps->flags &= ~PSTAT_ENV;
+    }
+}
+
+/* Account for the data designated by FLAGS, which has just been
+   fetched.  DIR must be locked.  */
+static void
+process_dir_note_fetched (struct process_dir *dir, ps_flags_t flags)
+{
+  struct proc_stat *ps = dir->ps;
+
+  if ((flags & PSTAT_ARGS) && ps->args)
+    memstat_add (MEMSTAT_PS_BUFFERS, ps->args_len);
+
+  if ((flags & PSTAT_ENV) && ps->env)
+    memstat_add (MEMSTAT_PS_BUFFERS, ps->env_len);
+}
+
+/* The reverse of process_dir_hold().  The data is released if this was
+   the last user.  DIR must be locked.  */
+static void
+process_dir_unhold (struct process_dir *dir, ps_flags_t flags)
+{
+  if (flags & PSTAT_ARGS)
+    dir->args_users--;
+  if (flags & PSTAT_ENV)
+    dir->env_users--;
+
+  process_dir_release (dir, flags);
+}
+
+static void
+process_dir_cleanup (void *hook)
+{
+  struct process_dir *dir = hook;
+
+  /* Account for the buffers released by _proc_stat_free().  */
+  process_dir_release (dir, PROCESS_TRANSIENT_FLAGS);
+
+  _proc_stat_free (dir->ps);
+  memstat_free (MEMSTAT_PROC_STAT, sizeof *dir->ps);
+  pthread_mutex_destroy (&dir->lock);
+  memstat_free (MEMSTAT_DIRS, sizeof *dir);
+  free (dir);
+}
+
+
 /* Implementation of the file nodes. */
 
 /* Describes a file in the process directories.  This structure is
@@ -237,6 +432,9 @@ process_file_gc_status (struct proc_stat *ps, char **contents)
    passed to the process_file_make_node function defined below.  */
 struct process_file_desc
 {
+  /* The name of the file, as reported in the trace of slow requests.  */
+  const char *name;
+
   /* The proc_stat information required to get the contents of this file.  */
   ps_flags_t needs;
 
@@ -245,8 +443,14 @@ struct process_file_desc
      hence this simplified signature.  */
   ssize_t (*get_contents) (struct proc_stat *ps, char **contents);
 
+  /* If specified, returns a cheap upper bound on the size of the contents,
+     using only the information already available in PS, or -1 if it
+     can't tell.  */
+  ssize_t (*get_size) (struct proc_stat *ps);
+
   /* The cmdline and environ contents don't need any cleaning since they
-     point directly into the proc_stat structure.  */
+     point directly into the proc_stat structure.  The corresponding data
+     is kept around until the contents are released.  */
   int no_cleanup;
 
   /* If specified, the file mode to be set with procfs_node_chmod().  */
@@ -256,35 +460,143 @@ struct process_file_desc
 struct process_file_node
 {
   const struct process_file_desc *desc;
-  struct proc_stat *ps;
+  struct process_dir *dir;
 };
 
-/* FIXME: lock the parent! */
 static error_t
 process_file_get_contents (void *hook, char **contents, ssize_t *contents_len)
 {
   struct process_file_node *file = hook;
+  struct process_dir *dir = file->dir;
+  ps_flags_t transient = file->desc->needs & PROCESS_TRANSIENT_FLAGS;
+  ps_flags_t fetched;
+  struct timespec start;
   error_t err;
 
+  trace_note_process (proc_stat_pid (dir->ps), file->desc->name,
+		      file->desc->needs);
+
+  /* Reading the memory of the process can block for a long time, so
+     don't let too many threads do it at once.  */
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  if (transient)
+    throttle_enter (&throttle_slow_generators);
+
+  pthread_mutex_lock (&dir->lock);
+  trace_note_phase (TRACE_WAIT, trace_ms_since (&start));
+
   /* Fetch the required information.  */
-  err = proc_stat_set_flags (file->ps, file->desc->needs);
-  if (err)
-    return EIO;
-  if ((proc_stat_flags (file->ps) & file->desc->needs) != file->desc->needs)
-    return EIO;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  fetched = ~proc_stat_flags (dir->ps);
+  err = proc_stat_set_flags (dir->ps, file->desc->needs);
+  if (transient)
+    throttle_leave (&throttle_slow_generators);
+  trace_note_phase (TRACE_FETCH, trace_ms_since (&start));
+
+  fetched &= proc_stat_flags (dir->ps);
+  process_dir_note_fetched (dir, fetched);
+
+  if (err
+      || (proc_stat_flags (dir->ps) & file->desc->needs) != file->desc->needs)
+    {
+      process_dir_release (dir, transient);
+      pthread_mutex_unlock (&dir->lock);
+      return EIO;
+    }
 
   /* Call the actual content generator (see the definitions below).  */
-  *contents_len = file->desc->get_contents (file->ps, contents);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  *contents_len = file->desc->get_contents (dir->ps, contents);
+  trace_note_phase (TRACE_FORMAT, trace_ms_since (&start));
+
+  /* Contents pointing into the proc_stat structure pin the corresponding
+     data until they are cleaned up, otherwise we're done with it.  */
+  if (file->desc->no_cleanup && *contents_len >= 0 && *contents)
+    process_dir_hold (dir, transient);
+  else
+    process_dir_release (dir, transient);
+
+  pthread_mutex_unlock (&dir->lock);
   return 0;
 }
 
+/* Contents pointing into the proc_stat structure are not freed, but
+   release the data they pin.  */
 static void
-process_file_cleanup_contents (void *hook, char *contents, ssize_t len)
+process_file_unhold_contents (void *hook, char *contents, ssize_t len)
 {
   struct process_file_node *file = hook;
+  struct process_dir *dir = file->dir;
+
+  if (! contents)
+    return;
 
-  if (! file->desc->no_cleanup)
-    free (contents);
+  pthread_mutex_lock (&dir->lock);
+  process_dir_unhold (dir, file->desc->needs & PROCESS_TRANSIENT_FLAGS);
+  pthread_mutex_unlock (&dir->lock);
+}
+
+/* This is called when the file is stat'ed, so nothing is fetched.  */
+static ssize_t
+process_file_estimate_size (void *hook)
+{
+  struct process_file_node *file = hook;
+  ssize_t size;
+
+  if (! file->desc->get_size)
+    return -1;
+
+  pthread_mutex_lock (&file->dir->lock);
+  size = file->desc->get_size (file->dir->ps);
+  pthread_mutex_unlock (&file->dir->lock);
+
+  return size;
+}
+
+/* The argument vector and environment change on exec, which the Hurd
+   does not record the time of, so they are dated by the creation of the
+   process, and by the changes seen by the reads.  Unlike the arguments,
+   the creation time only takes a call to the kernel to fetch, and it is
+   fetched once.  The files which show anything else sample counters
+   which change all the time.  */
+static void
+process_file_get_mtime (void *hook, struct timespec *mtime)
+{
+  struct process_file_node *file = hook;
+  struct process_dir *dir = file->dir;
+  task_basic_info_t tbi;
+
+  if (file->desc->needs & ~PROCESS_TRANSIENT_FLAGS)
+    {
+      clock_gettime (CLOCK_REALTIME, mtime);
+      return;
+    }
+
+  pthread_mutex_lock (&dir->lock);
+  if (! dir->start_known
+      && ! proc_stat_set_flags (dir->ps, PSTAT_TASK_BASIC)
+      && (proc_stat_flags (dir->ps) & PSTAT_TASK_BASIC))
+    {
+      tbi = proc_stat_task_basic_info (dir->ps);
+      dir->start.tv_sec = tbi->creation_time.seconds;
+      dir->start.tv_nsec = tbi->creation_time.microseconds * 1000;
+      dir->start_known = 1;
+    }
+
+  if (dir->start_known)
+    *mtime = dir->start;
+  else
+    clock_gettime (CLOCK_REALTIME, mtime);
+  pthread_mutex_unlock (&dir->lock);
+}
+
+static void
+process_file_cleanup (void *hook)
+{
+  struct process_file_node *file = hook;
+
+  memstat_free (MEMSTAT_DIRS, sizeof *file);
+  free (file);
 }
 
 static struct node *
@@ -292,9 +604,19 @@ process_file_make_node (void *dir_hook, const void *entry_hook)
 {
   static const struct procfs_node_ops ops = {
     .get_contents = process_file_get_contents,
-    .cleanup_contents = process_file_cleanup_contents,
-    .cleanup = free,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+    .cleanup = process_file_cleanup,
+    .estimate_size = process_file_estimate_size,
+    .get_mtime = process_file_get_mtime,
   };
+  static const struct procfs_node_ops no_cleanup_ops = {
+    .get_contents = process_file_get_contents,
+    .cleanup_contents = process_file_unhold_contents,
+    .cleanup = process_file_cleanup,
+    .estimate_size = process_file_estimate_size,
+    .get_mtime = process_file_get_mtime,
+  };
+  const struct process_file_desc *desc = entry_hook;
   struct process_file_node *f;
   struct node *np;
 
@@ -302,14 +624,15 @@ process_file_make_node (void *dir_hook, const void *entry_hook)
   if (! f)
     return NULL;
 
-  f->desc = entry_hook;
-  f->ps = dir_hook;
+  f->desc = desc;
+  f->dir = dir_hook;
+  memstat_alloc (MEMSTAT_DIRS, sizeof *f);
 
-  np = procfs_make_node (&ops, f);
+  np = procfs_make_node (desc->no_cleanup ? &no_cleanup_ops : &ops, f);
   if (! np)
     return NULL;
 
-  procfs_node_chown (np, proc_stat_owner_uid (f->ps));
+  procfs_node_chown (np, proc_stat_owner_uid (f->dir->ps));
   if (f->desc->mode)
     procfs_node_chmod (np, f->desc->mode);
 
@@ -333,7 +656,9 @@ static struct procfs_dir_entry entries[] = {
   {
     .name = "cmdline",
     .hook = & (struct process_file_desc) {
+      .name = "cmdline",
       .get_contents = process_file_gc_cmdline,
+      .get_size = process_file_size_cmdline,
       .needs = PSTAT_ARGS,
       .no_cleanup = 1,
     },
@@ -341,7 +666,9 @@ static struct procfs_dir_entry entries[] = {
   {
     .name = "environ",
     .hook = & (struct process_file_desc) {
+      .name = "environ",
       .get_contents = process_file_gc_environ,
+      .get_size = process_file_size_environ,
       .needs = PSTAT_ENV,
       .no_cleanup = 1,
       .mode = 0400,
@@ -350,7 +677,9 @@ static struct procfs_dir_entry entries[] = {
   {
     .name = "stat",
     .hook = & (struct process_file_desc) {
+      .name = "stat",
       .get_contents = process_file_gc_stat,
+      .get_size = process_file_size_stat,
       .needs = PSTAT_PID | PSTAT_ARGS | PSTAT_STATE | PSTAT_PROC_INFO
 	| PSTAT_TASK | PSTAT_TASK_BASIC | PSTAT_THREAD_BASIC
 	| PSTAT_THREAD_WAIT,
@@ -362,14 +691,18 @@ static struct procfs_dir_entry entries[] = {
   {
     .name = "statm",
     .hook = & (struct process_file_desc) {
+      .name = "statm",
       .get_contents = process_file_gc_statm,
+      .get_size = process_file_size_statm,
       .needs = PSTAT_TASK_BASIC,
     },
   },
   {
     .name = "status",
     .hook = & (struct process_file_desc) {
+      .name = "status",
       .get_contents = process_file_gc_status,
+      .get_size = process_file_size_status,
       .needs = PSTAT_PID | PSTAT_ARGS | PSTAT_STATE | PSTAT_PROC_INFO
         | PSTAT_TASK_BASIC | PSTAT_OWNER_UID | PSTAT_NUM_THREADS,
     },
@@ -382,11 +715,14 @@ process_lookup_pid (struct ps_context *pc, pid_t pid, struct node **np)
 {
   static const struct procfs_dir_ops dir_ops = {
     .entries = entries,
-    .cleanup = (void (*)(void *)) _proc_stat_free,
+    .cleanup = process_dir_cleanup,
     .entry_ops = {
       .make_node = process_file_make_node,
+      .type = DT_REG,
     },
+    .cache_nodes = 1,
   };
+  struct process_dir *dir;
   struct proc_stat *ps;
   int owner;
   error_t err;
@@ -404,7 +740,22 @@ process_lookup_pid (struct ps_context *pc, pid_t pid, struct node **np)
       return EIO;
     }
 
-  *np = procfs_dir_make_node (&dir_ops, ps);
+  dir = malloc (sizeof *dir);
+  if (! dir)
+    {
+      _proc_stat_free (ps);
+      return ENOMEM;
+    }
+
+  dir->ps = ps;
+  memstat_alloc (MEMSTAT_PROC_STAT, sizeof *ps);
+  memstat_alloc (MEMSTAT_DIRS, sizeof *dir);
+  pthread_mutex_init (&dir->lock, NULL);
+  dir->args_users = 0;
+  dir->env_users = 0;
+  dir->start_known = 0;
+
+  *np = procfs_dir_make_node (&dir_ops, dir);
   if (! *np)
     return ENOMEM;
 
@@ -25,3 +25,18 @@
 error_t
 process_lookup_pid (struct ps_context *pc, pid_t pid, struct node **np);
 
+/* Helper functions which are also useful to other modules presenting
+   process information.  */
+
+/* Return the one-character state of PS, as shown in [pid]/stat.  PS must
+   have PSTAT_STATE.  */
+char state_char (struct proc_stat *ps);
+
+/* Convert TV to clock ticks, as used in [pid]/stat.  */
+long long int timeval_jiffies (time_value_t tv);
+
+/* Given the argument vector ARGS of a process, return its command name.
+   This is not null-terminated, and its length is given by
+   args_filename_length().  */
+const char *args_filename (const char *args);
+int args_filename_length (const char *name);
@@ -19,12 +19,39 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <malloc.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
 #include <mach.h>
 #include <hurd/netfs.h>
 #include <hurd/fshelp.h>
 #include "procfs.h"
+#include "throttle.h"
+#include "trace.h"
+#include "memstat.h"
+
+/* A generation of the contents of a node.  It is referenced by the node
+   as long as it is the current one, and by the views which use it.  */
+struct procfs_contents
+{
+  int references;
+  char *data;
+  ssize_t len;
+};
+
+/* Since nodes can be shared, each user of a node reads the contents it
+   got when it last started reading from the beginning, rather than the
+   current ones, so that its reads are not torn by the refreshes of the
+   other users.  The iouser of libnetfs is specific to each open of the
+   node, and identifies it.  */
+struct procfs_view
+{
+  struct iouser *user;
+  struct procfs_contents *contents;
+  struct procfs_view *next;
+};
 
 struct netnode
 {
@@ -32,11 +59,26 @@ struct netnode
   void *hook;
 
   /* (cached) contents of the node */
-  char *contents;
-  ssize_t contents_len;
+  struct procfs_contents *contents;
+
+  /* views of the users, most recently used first */
+  struct procfs_view *views;
+  int num_views;
 
   /* parent directory, if applicable */
   struct node *parent;
+
+  /* name of the node, if it is known statically */
+  const char *name;
+
+  /* weak reference to this node, if any */
+  struct node **weak_ref;
+
+  /* length and hash of the last generated contents, used to detect
+     changes and update the modification time accordingly */
+  int generated;
+  ssize_t last_len;
+  size_t last_hash;
 };
 
 void
@@ -69,6 +111,8 @@ struct node *procfs_make_node (const struct procfs_node_ops *ops, void *hook)
     goto fail;
 
   np->nn = nn;
+  memstat_alloc (MEMSTAT_NODES, sizeof *nn);
+  memstat_alloc (MEMSTAT_NODES, sizeof *np);
   memset (&np->nn_stat, 0, sizeof np->nn_stat);
   np->nn_translated = 0;
 
@@ -80,6 +124,12 @@ struct node *procfs_make_node (const struct procfs_node_ops *ops, void *hook)
   np->nn_stat.st_uid = getuid ();
   np->nn_stat.st_gid = getgid ();
 
+  if (ops->get_mtime)
+    ops->get_mtime (hook, &np->nn_stat.st_mtim);
+  else
+    clock_gettime (CLOCK_REALTIME, &np->nn_stat.st_mtim);
+  np->nn_stat.st_atim = np->nn_stat.st_ctim = np->nn_stat.st_mtim;
+
   return np;
 
 fail:
@@ -109,6 +159,70 @@ void procfs_node_chtype (struct node *np, mode_t type)
     procfs_node_chmod (np, 0777);
 }
 
+void procfs_node_set_name (struct node *np, const char *name)
+{
+  np->nn->name = name;
+}
+
+/* Return the name of NP for the traces, or its kind if it is unknown.  */
+static const char *
+procfs_trace_name (struct node *np)
+{
+  if (np->nn->name)
+    return np->nn->name;
+
+  switch (np->nn_stat.st_mode & S_IFMT)
+    {
+    case S_IFDIR:
+      return "(directory)";
+    case S_IFLNK:
+      return "(symlink)";
+    default:
+      return "(file)";
+    }
+}
+
+struct node *procfs_weak_ref_get (struct node **slot)
+{
+  struct node *np;
+
+  pthread_spin_lock (&netfs_node_refcnt_lock);
+  np = *slot;
+  if (np)
+    np->references++;
+  pthread_spin_unlock (&netfs_node_refcnt_lock);
+
+  return np;
+}
+
+struct node *procfs_weak_ref_set (struct node **slot, struct node *np)
+{
+  struct node *prev;
+
+  assert (! np->nn->weak_ref);
+
+  pthread_spin_lock (&netfs_node_refcnt_lock);
+  prev = *slot;
+  if (prev)
+    prev->references++;
+  else
+    {
+      *slot = np;
+      np->nn->weak_ref = slot;
+    }
+  pthread_spin_unlock (&netfs_node_refcnt_lock);
+
+  return prev ?: np;
+}
+
+void procfs_drop_weak_ref (struct node *np)
+{
+  if (np->nn->weak_ref && *np->nn->weak_ref == np)
+    *np->nn->weak_ref = NULL;
+
+  np->nn->weak_ref = NULL;
+}
+
 /* FIXME: possibly not the fastest hash function... */
 ino64_t
 procfs_make_ino (struct node *np, const char *filename)
@@ -132,38 +246,255 @@ procfs_make_ino (struct node *np, const char *filename)
   return (unsigned long) jrand48 (x);
 }
 
+/* FNV-1a, which is good enough to tell generated contents apart.  */
+static size_t
+procfs_hash_contents (const char *contents, ssize_t len)
+{
+  size_t h = 2166136261u;
+
+  while (len--)
+    h = (h ^ (unsigned char) *contents++) * 16777619u;
+
+  return h;
+}
+
+/* Called when new contents have been generated for NP.  The modification
+   time is bumped when they differ from the previous ones, and is kept
+   strictly increasing so that no change can go unnoticed.  */
+static void
+procfs_note_contents (struct node *np, const char *contents, ssize_t len)
+{
+  size_t h = procfs_hash_contents (contents, len);
+  struct timespec now, *mtim = &np->nn_stat.st_mtim;
+
+  if (np->nn->generated && len == np->nn->last_len && h == np->nn->last_hash)
+    return;
+
+  if (np->nn->generated)
+    {
+      clock_gettime (CLOCK_REALTIME, &now);
+      if (now.tv_sec < mtim->tv_sec
+	  || (now.tv_sec == mtim->tv_sec && now.tv_nsec <= mtim->tv_nsec))
+	{
+	  now = *mtim;
+	  if (++now.tv_nsec >= 1000000000)
+	    {
+	      now.tv_sec++;
+	      now.tv_nsec = 0;
+	    }
+	}
+      *mtim = np->nn_stat.st_ctim = now;
+    }
+
+  np->nn->generated = 1;
+  np->nn->last_len = len;
+  np->nn->last_hash = h;
+}
+
+/* Whether the contents of NP are allocated by its get_contents callback,
+   as opposed to pointing into some data it keeps.  */
+static int
+procfs_owns_contents (struct node *np)
+{
+  return np->nn->ops->cleanup_contents == procfs_cleanup_contents_with_free;
+}
+
+/* The size of the buffer holding DATA, which can be larger than the
+   contents when it was allocated for the worst case, as by proclist, or
+   grown by open_memstream().  */
+static size_t
+procfs_contents_size (const char *data)
+{
+  return malloc_usable_size ((void *) data);
+}
+
+static void
+procfs_contents_release (struct node *np, struct procfs_contents *c)
+{
+  if (--c->references)
+    return;
+
+  memstat_free (MEMSTAT_CONTENTS, sizeof *c);
+  if (procfs_owns_contents (np) && c->data)
+    memstat_free (MEMSTAT_CONTENTS, procfs_contents_size (c->data));
+  if (np->nn->ops->cleanup_contents)
+    np->nn->ops->cleanup_contents (np->nn->hook, c->data, c->len);
+  free (c);
+}
+
+int procfs_has_contents (struct node *np)
+{
+  return np->nn->contents != NULL;
+}
+
 error_t procfs_get_contents (struct node *np, char **data, ssize_t *data_len)
 {
   if (! np->nn->contents && np->nn->ops->get_contents)
     {
+      struct procfs_contents *c;
       char *contents;
       ssize_t contents_len;
       error_t err;
 
+      struct timespec start;
+      double ms;
+
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      trace_begin ();
       contents_len = -1;
       err = np->nn->ops->get_contents (np->nn->hook, &contents, &contents_len);
+
+      /* Charge the generation time to the client we're working for, and
+	 record it if it was slow.  */
+      ms = trace_ms_since (&start);
+      throttle_client_charge (ms);
+      trace_end (np->nn_stat.st_ino, procfs_trace_name (np), ms);
+
       if (err)
 	return err;
       if (contents_len < 0)
 	return ENOMEM;
 
-      np->nn->contents = contents;
-      np->nn->contents_len = contents_len;
+      c = malloc (sizeof *c);
+      if (! c)
+	{
+	  if (np->nn->ops->cleanup_contents)
+	    np->nn->ops->cleanup_contents (np->nn->hook, contents,
+					   contents_len);
+	  return ENOMEM;
+	}
+
+      c->references = 1;
+      c->data = contents;
+      c->len = contents_len;
+      np->nn->contents = c;
+      memstat_alloc (MEMSTAT_CONTENTS, sizeof *c);
+      if (procfs_owns_contents (np) && contents)
+	memstat_alloc (MEMSTAT_CONTENTS, procfs_contents_size (contents));
+      procfs_note_contents (np, contents, contents_len);
     }
 
-  *data = np->nn->contents;
-  *data_len = np->nn->contents_len;
+  *data = np->nn->contents ? np->nn->contents->data : NULL;
+  *data_len = np->nn->contents ? np->nn->contents->len : 0;
   return 0;
 }
 
+error_t procfs_generate_contents (struct node *np,
+				  char **data, ssize_t *data_len)
+{
+  error_t err;
+
+  *data = NULL;
+  *data_len = 0;
+  if (! np->nn->ops->get_contents)
+    return 0;
+
+  *data_len = -1;
+  err = np->nn->ops->get_contents (np->nn->hook, data, data_len);
+  if (! err && *data_len < 0)
+    err = ENOMEM;
+
+  return err;
+}
+
+void procfs_release_contents (struct node *np, char *data, ssize_t data_len)
+{
+  if (np->nn->ops->cleanup_contents)
+    np->nn->ops->cleanup_contents (np->nn->hook, data, data_len);
+}
+
 void procfs_refresh (struct node *np)
 {
-  if (np->nn->contents && np->nn->ops->cleanup_contents)
-    np->nn->ops->cleanup_contents (np->nn->hook, np->nn->contents, np->nn->contents_len);
+  if (np->nn->contents)
+    procfs_contents_release (np, np->nn->contents);
 
   np->nn->contents = NULL;
 }
 
+/* Drop the least recently used views of NP while there are more of them
+   than references to NP.  Each open holds a reference, so that the views
+   of the users which have closed the node don't accumulate.  */
+static void
+procfs_prune_views (struct node *np)
+{
+  struct procfs_view **vp, *v;
+  int references;
+
+  pthread_spin_lock (&netfs_node_refcnt_lock);
+  references = np->references;
+  pthread_spin_unlock (&netfs_node_refcnt_lock);
+
+  while (np->nn->num_views > references && np->nn->num_views > 1)
+    {
+      for (vp = &np->nn->views; (*vp)->next; vp = &(*vp)->next);
+      v = *vp;
+      *vp = NULL;
+      np->nn->num_views--;
+
+      procfs_contents_release (np, v->contents);
+      memstat_free (MEMSTAT_CONTENTS, sizeof *v);
+      free (v);
+    }
+}
+
+error_t procfs_get_user_contents (struct node *np, struct iouser *user,
+				  int refresh, char **data, ssize_t *data_len)
+{
+  struct procfs_view **vp, *v;
+  error_t err;
+
+  for (vp = &np->nn->views; *vp && (*vp)->user != user; vp = &(*vp)->next);
+  v = *vp;
+
+  if (v)
+    {
+      /* Move it first.  */
+      *vp = v->next;
+      v->next = np->nn->views;
+      np->nn->views = v;
+
+      if (! refresh)
+	{
+	  *data = v->contents->data;
+	  *data_len = v->contents->len;
+	  return 0;
+	}
+    }
+
+  if (refresh)
+    procfs_refresh (np);
+
+  err = procfs_get_contents (np, data, data_len);
+  if (err || ! np->nn->contents)
+    return err;
+
+  if (! v)
+    {
+      /* Without a view, the user simply gets the current contents.  */
+      v = malloc (sizeof *v);
+      if (! v)
+	return 0;
+
+      memstat_alloc (MEMSTAT_CONTENTS, sizeof *v);
+      v->user = user;
+      v->contents = NULL;
+      v->next = np->nn->views;
+      np->nn->views = v;
+      np->nn->num_views++;
+    }
+
+  if (v->contents != np->nn->contents)
+    {
+      if (v->contents)
+	procfs_contents_release (np, v->contents);
+      v->contents = np->nn->contents;
+      v->contents->references++;
+    }
+
+  procfs_prune_views (np);
+  return 0;
+}
+
 error_t procfs_lookup (struct node *np, const char *name, struct node **npp)
 {
   error_t err = ENOENT;
@@ -182,19 +513,55 @@ error_t procfs_lookup (struct node *np, const char *name, struct node **npp)
 
   if (err && np->nn->ops->lookup)
     {
+      struct timespec start;
+
+      /* Creating the node can take as long as generating contents, for
+	 instance for the process directories, so it is charged the same
+	 way.  */
+      clock_gettime (CLOCK_MONOTONIC, &start);
       err = np->nn->ops->lookup (np->nn->hook, name, npp);
+      throttle_client_charge (trace_ms_since (&start));
+
+      /* Nodes can be reused by the lookup function, in which case they
+	 already have a parent.  Otherwise they have just been created,
+	 but they may have been returned to a concurrent lookup already,
+	 so the child's lock is needed to set their parent only once.  */
       if (! err)
         {
-	  (*npp)->nn_stat.st_ino = procfs_make_ino (np, name);
-	  netfs_nref ((*npp)->nn->parent = np);
+	  pthread_mutex_lock (&(*npp)->lock);
+	  if (! (*npp)->nn->parent)
+	    {
+	      (*npp)->nn_stat.st_ino = procfs_make_ino (np, name);
+	      netfs_nref ((*npp)->nn->parent = np);
+	    }
+	  pthread_mutex_unlock (&(*npp)->lock);
 	}
     }
 
   return err;
 }
 
+error_t procfs_lookup_delegate (struct node *np, const char *name,
+				struct node **npp)
+{
+  if (! np->nn->ops->lookup)
+    return ENOENT;
+
+  return np->nn->ops->lookup (np->nn->hook, name, npp);
+}
+
 void procfs_cleanup (struct node *np)
 {
+  struct procfs_view *v;
+
+  while ((v = np->nn->views))
+    {
+      np->nn->views = v->next;
+      procfs_contents_release (np, v->contents);
+      memstat_free (MEMSTAT_CONTENTS, sizeof *v);
+      free (v);
+    }
+
   procfs_refresh (np);
 
   if (np->nn->ops->cleanup)
@@ -203,9 +570,29 @@ void procfs_cleanup (struct node *np)
   if (np->nn->parent)
     netfs_nrele (np->nn->parent);
 
+  memstat_free (MEMSTAT_NODES, sizeof *np->nn);
+  memstat_free (MEMSTAT_NODES, sizeof *np);
   free (np->nn);
 }
 
+error_t procfs_write (struct node *np, struct iouser *user,
+		      const char *data, size_t *len)
+{
+  error_t err;
+
+  if (! np->nn->ops->write)
+    return EROFS;
+
+  err = np->nn->ops->write (np->nn->hook, user, data, len);
+  procfs_refresh (np);
+  return err;
+}
+
+int procfs_writable (struct node *np)
+{
+  return np->nn->ops->write != NULL;
+}
+
 error_t procfs_get_translator (struct node *np,
                                char **argz,
                                size_t *argz_len)
@@ -217,3 +604,45 @@ error_t procfs_get_translator (struct node *np,
   *argz_len = 0;
   return 0;
 }
+
+loff_t procfs_get_size (struct node *np)
+{
+  ssize_t size;
+
+  if (np->nn->contents)
+    return np->nn->contents->len;
+
+  if (np->nn->ops->estimate_size)
+    {
+      size = np->nn->ops->estimate_size (np->nn->hook);
+      if (size >= 0)
+	return size;
+    }
+
+  return 0;
+}
+
+void procfs_update_mtime (struct node *np)
+{
+  struct timespec t, *mtim = &np->nn_stat.st_mtim;
+
+  if (np->nn->ops->get_mtime)
+    np->nn->ops->get_mtime (np->nn->hook, &t);
+  else
+    clock_gettime (CLOCK_REALTIME, &t);
+
+  if (t.tv_sec > mtim->tv_sec
+      || (t.tv_sec == mtim->tv_sec && t.tv_nsec > mtim->tv_nsec))
+    *mtim = np->nn_stat.st_ctim = t;
+}
+
+unsigned char procfs_get_dirent_type (struct node *np, const char *name)
+{
+  if (! strcmp (name, ".") || ! strcmp (name, ".."))
+    return DT_DIR;
+
+  if (np->nn->ops->get_dirent_type)
+    return np->nn->ops->get_dirent_type (np->nn->hook, name);
+
+  return DT_UNKNOWN;
+}
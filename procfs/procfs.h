@@ -54,6 +54,34 @@ struct procfs_node_ops
 
   /* Get the passive translator record.  */
   error_t (*get_translator) (void *hook, char **argz, size_t *argz_len);
+
+  /* Get the type of the entry NAME of this directory as a DT_* value,
+     without creating the corresponding node.  This is used to fill in
+     the directory entries returned by readdir, so that clients don't
+     have to stat each of them.  Return DT_UNKNOWN if the information is
+     not readily available.  */
+  unsigned char (*get_dirent_type) (void *hook, const char *name);
+
+  /* Return a cheap upper bound on the length of the contents of this
+     regular file, using only the information at hand, or -1 if there is
+     none.  This is called when the file is stat'ed, so it must not fetch
+     anything.  It is reported as the file size as long as no contents are
+     cached, so that readers can size their buffers appropriately.  */
+  ssize_t (*estimate_size) (void *hook);
+
+  /* Get the time at which the data this regular file is generated from
+     last changed, using the timestamps the data carries, such as the
+     creation time of a process, without generating the contents.  Files
+     without this callback are assumed to change all the time, and report
+     the current time when stat'ed.  */
+  void (*get_mtime) (void *hook, struct timespec *mtime);
+
+  /* Handle a write of *LEN bytes from DATA by USER to this file, and set
+     *LEN to the number of bytes actually consumed.  The cached contents
+     are forgotten afterwards.  Files without this callback are
+     read-only.  */
+  error_t (*write) (void *hook, struct iouser *user,
+		    const char *data, size_t *len);
 };
 
 /* These helper functions can be used as procfs_node_ops.cleanup_contents. */
@@ -77,6 +105,27 @@ void procfs_node_chmod (struct node *np, mode_t mode);
    node has been created.  */
 void procfs_node_chtype (struct node *np, mode_t type);
 
+/* Record NAME as the name of the node NP, for the slow-requests file.
+   NAME is not copied, and is kept in the file after the node is gone, so
+   it must be static, like the names of the entries of the procfs_dir
+   directories.  Must be called right after the node has been created.  */
+void procfs_node_set_name (struct node *np, const char *name);
+
+/* A weak reference is a node pointer which does not keep the node alive,
+   but is reset to NULL when the node is destroyed.  The storage for it
+   must remain valid until then, which is the case for instance if it is
+   part of the parent's hook.  */
+
+/* Get a new reference to the node *SLOT refers to, or NULL if there is
+   no such node (anymore).  */
+struct node *procfs_weak_ref_get (struct node **slot);
+
+/* Make *SLOT a weak reference to the newly created node NP, which must
+   not already have one.  If *SLOT already refers to a node, it is left
+   unchanged and a new reference to this existing node is returned
+   instead of NP, in which case the caller should drop NP.  */
+struct node *procfs_weak_ref_set (struct node **slot, struct node *np);
+
 
 /* Interface for the libnetfs side. */
 
@@ -87,13 +136,63 @@ ino64_t procfs_make_ino (struct node *np, const char *filename);
 
 /* Forget the current cached contents for the node.  This is done before reads
    from offset 0, to ensure that the data are recent even for utilities such as
-   top which keep some nodes open.  */
+   top which keep some nodes open.  The users which are partway through reading
+   the previous contents keep them until they read from offset 0 again.  */
 void procfs_refresh (struct node *np);
 
+/* Get the contents of NP for USER, which has it open.  If REFRESH is
+   set, USER starts reading from the beginning and the contents are
+   generated anew.  Otherwise, USER keeps getting the contents it got
+   last, whatever the other users of NP did in the meantime, or the
+   current ones if it has none yet.  */
+error_t procfs_get_user_contents (struct node *np, struct iouser *user,
+				  int refresh, char **data, ssize_t *data_len);
+
+/* Generate new contents for the locked node NP, without affecting the
+   cached ones, for instance to copy them.  They must be released with
+   procfs_release_contents.  */
+error_t procfs_generate_contents (struct node *np,
+				  char **data, ssize_t *data_len);
+void procfs_release_contents (struct node *np, char *data, ssize_t data_len);
+
+/* Return nonzero if the contents of NP are cached.  */
+int procfs_has_contents (struct node *np);
+
 error_t procfs_get_contents (struct node *np, char **data, ssize_t *data_len);
 error_t procfs_lookup (struct node *np, const char *name, struct node **npp);
+
+/* Look up NAME with the lookup callback of NP only.  Unlike procfs_lookup,
+   this doesn't make NP the parent of the node found, so that the
+   directories which gather the entries of others, such as dircat, can
+   let the lookup made in them set it.  */
+error_t procfs_lookup_delegate (struct node *np, const char *name,
+				struct node **npp);
 void procfs_cleanup (struct node *np);
 
+/* Reset the weak reference to NP, if any.  This must be done with
+   netfs_node_refcnt_lock held, at the time the last reference to NP is
+   dropped, so that it cannot be revived by procfs_weak_ref_get().  */
+void procfs_drop_weak_ref (struct node *np);
+
+/* Write to NP on behalf of USER.  Return EROFS if NP is read-only.  */
+error_t procfs_write (struct node *np, struct iouser *user,
+		      const char *data, size_t *len);
+
+/* Return nonzero if NP can be written to.  */
+int procfs_writable (struct node *np);
+
 /* Get the passive translator record if any.  */
 error_t procfs_get_translator (struct node *np, char **argz, size_t *argz_len);
 
+/* Get the size of the contents of the regular file NP: the length of the
+   cached contents if any, otherwise an upper bound, or 0 if unknown.  */
+loff_t procfs_get_size (struct node *np);
+
+/* Bring the modification time of the regular file NP up to date before
+   it is stat'ed.  It is the most recent of the time reported by its
+   get_mtime callback, and of the last change seen by a read.  */
+void procfs_update_mtime (struct node *np);
+
+/* Get the type of the entry NAME of the directory NP as a DT_* value.  */
+unsigned char procfs_get_dirent_type (struct node *np, const char *name);
+
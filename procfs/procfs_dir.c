@@ -19,13 +19,20 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
 #include "procfs.h"
 #include "procfs_dir.h"
+#include "memstat.h"
 
 struct procfs_dir_node
 {
   const struct procfs_dir_ops *ops;
   void *hook;
+
+  /* Weak references to the NUM_NODES nodes of the entries, if
+     ops->cache_nodes is set.  Indexed like ops->entries.  */
+  size_t num_nodes;
+  struct node *nodes[0];
 };
 
 static int
@@ -77,11 +84,22 @@ procfs_dir_lookup (void *hook, const char *name, struct node **np)
 {
   struct procfs_dir_node *dir = hook;
   const struct procfs_dir_entry *ent;
+  struct node **slot = NULL;
+  struct node *prev;
 
   for (ent = dir->ops->entries; ent->name && strcmp (name, ent->name); ent++);
   if (! ent->name)
     return ENOENT;
 
+  if (dir->ops->cache_nodes
+      && ! (ent->ops.private_nodes || dir->ops->entry_ops.private_nodes))
+    {
+      slot = &dir->nodes[ent - dir->ops->entries];
+      *np = procfs_weak_ref_get (slot);
+      if (*np)
+	return 0;
+    }
+
   if (ent->ops.make_node)
     *np = ent->ops.make_node (dir->hook, ent->hook);
   else if (dir->ops->entry_ops.make_node)
@@ -92,9 +110,35 @@ procfs_dir_lookup (void *hook, const char *name, struct node **np)
   if (! *np)
     return ENOMEM;
 
+  procfs_node_set_name (*np, ent->name);
+
+  if (slot)
+    {
+      /* Someone else may have created the node in the meantime.  */
+      prev = procfs_weak_ref_set (slot, *np);
+      if (prev != *np)
+	{
+	  netfs_nrele (*np);
+	  *np = prev;
+	}
+    }
+
   return 0;
 }
 
+static unsigned char
+procfs_dir_get_dirent_type (void *hook, const char *name)
+{
+  struct procfs_dir_node *dir = hook;
+  const struct procfs_dir_entry *ent;
+
+  for (ent = dir->ops->entries; ent->name && strcmp (name, ent->name); ent++);
+  if (! ent->name)
+    return DT_UNKNOWN;
+
+  return ent->ops.type ?: dir->ops->entry_ops.type;
+}
+
 static void
 procfs_dir_cleanup (void *hook)
 {
@@ -103,6 +147,8 @@ procfs_dir_cleanup (void *hook)
   if (dir->ops->cleanup)
     dir->ops->cleanup (dir->hook);
 
+  memstat_free (MEMSTAT_DIRS,
+		sizeof *dir + dir->num_nodes * sizeof dir->nodes[0]);
   free (dir);
 }
 
@@ -114,10 +160,17 @@ procfs_dir_make_node (const struct procfs_dir_ops *dir_ops, void *dir_hook)
     .lookup = procfs_dir_lookup,
     .cleanup_contents = procfs_cleanup_contents_with_free,
     .cleanup = procfs_dir_cleanup,
+    .get_dirent_type = procfs_dir_get_dirent_type,
   };
+  const struct procfs_dir_entry *ent;
   struct procfs_dir_node *dir;
+  size_t num_nodes = 0;
+
+  if (dir_ops->cache_nodes)
+    for (ent = dir_ops->entries; ent->name; ent++)
+      num_nodes++;
 
-  dir = malloc (sizeof *dir);
+  dir = malloc (sizeof *dir + num_nodes * sizeof dir->nodes[0]);
   if (! dir)
     {
       if (dir_ops->cleanup)
@@ -128,6 +181,9 @@ procfs_dir_make_node (const struct procfs_dir_ops *dir_ops, void *dir_hook)
 
   dir->ops = dir_ops;
   dir->hook = dir_hook;
+  dir->num_nodes = num_nodes;
+  memset (dir->nodes, 0, num_nodes * sizeof dir->nodes[0]);
+  memstat_alloc (MEMSTAT_DIRS, sizeof *dir + num_nodes * sizeof dir->nodes[0]);
 
   return procfs_make_node (&ops, dir);
 }
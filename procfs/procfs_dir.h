@@ -31,6 +31,12 @@ struct procfs_dir_entry_ops
   struct node *(*make_node)(void *dir_hook, const void *entry_hook);
   /* If this is provided and returns 0, this entry will be hidden.  */
   int (*exists)(void *dir_hook, const void *entry_hook);
+  /* The DT_* type reported by readdir for this entry.  It should match
+     the type of the node created by make_node.  */
+  unsigned char type;
+  /* If set, a new node is created for each lookup of this entry even if
+     the directory caches its nodes, so that it can hold per-open state.  */
+  int private_nodes;
 };
 
 /* Describes an individual directory entry, associating a NAME with
@@ -45,12 +51,16 @@ struct procfs_dir_entry
 /* Describes a complete directory. ENTRIES is a table terminated by a
    null NAME field. ENTRY_OPS provides default operations for the
    entries which don't specify them.  The optional CLEANUP function
-   should release all the resources associated with the directory hook.  */
+   should release all the resources associated with the directory hook.
+   If CACHE_NODES is set, the directory keeps a weak reference to the
+   node created for each entry, and further lookups return that same
+   node (along with its cached contents) for as long as it exists.  */
 struct procfs_dir_ops
 {
   const struct procfs_dir_entry *entries;
   void (*cleanup)(void *dir_hook);
   struct procfs_dir_entry_ops entry_ops;
+  int cache_nodes;
 };
 
 /* Create and return a new node for the directory described in OPS.
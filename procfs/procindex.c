@@ -0,0 +1,1061 @@
+/* Hurd /proc filesystem, indexes of the processes by attribute.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <mach.h>
+#include <hurd/process.h>
+#include <ps.h>
+#include "procfs.h"
+#include "procindex.h"
+#include "process.h"
+#include "memstat.h"
+#include "main.h"
+
+/* This module maintains a table of the processes along with some of their
+   attributes, and publishes it as directories such as /proc/by-uid, so
+   that finding the processes owned by a given user or running a given
+   command does not require reading the status of every single process.
+
+   The table is kept sorted by PID.  When the index is needed and the
+   process list is older than PROCINDEX_TTL seconds, the list is retrieved
+   again and the table is updated incrementally: entries are added and
+   removed as processes appear and disappear, and the remaining ones keep
+   their attributes.  Once the table exists, the listings of the root
+   directory, which retrieve the process list anyway, update it the same
+   way.  The owners, the parents and the command names can change over
+   the lifetime of a process, by setuid, reparenting and exec, so they are
+   all fetched again when they are older than PROCINDEX_TTL.
+
+   The RPCs to the proc server are made without holding procindex_lock,
+   so that the readers of the table are never held up by them, and their
+   results are merged into the table afterwards.  The refreshes are
+   serialized by procindex_refresh_lock, so that concurrent readers don't
+   duplicate the work.  */
+
+/* How long the index is used before being refreshed, in seconds.  */
+#define PROCINDEX_TTL 1
+
+/* The number of process creations and exits remembered for the change
+   feed.  */
+#define PROCINDEX_LOG_SIZE 1024
+
+/* Large enough for any number printed below.  */
+#define NUMBER_STR_SIZE (3 * sizeof (long long int) + 1)
+
+struct procindex_entry
+{
+  pid_t pid;
+
+  /* The owner of the process, or -1 if it is not known yet.  */
+  int owner;
+
+  /* The parent of the process, or -1 if it is not known yet.  */
+  pid_t ppid;
+
+  /* The command name, or NULL if not known yet.  The empty string is
+     used when it could not be retrieved.  */
+  char *name;
+};
+
+static pthread_mutex_t procindex_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t procindex_refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct procindex_entry *procindex_entries;
+static size_t procindex_num_entries;
+static size_t procindex_entries_size;
+static time_t procindex_pids_refreshed;
+static time_t procindex_owners_refreshed;
+static time_t procindex_parents_refreshed;
+static time_t procindex_names_refreshed;
+
+/* Whether the list of the processes is being retrieved by procindex_prewarm,
+   or was retrieved by it and has not been handed to proclist yet.  */
+static enum
+{
+  PROCINDEX_COLD,
+  PROCINDEX_PREWARMING,
+  PROCINDEX_PREWARMED,
+} procindex_prewarm_state;
+static pthread_cond_t procindex_prewarm_cond = PTHREAD_COND_INITIALIZER;
+
+/* The processes which appeared or disappeared, as a ring buffer.  Each
+   update of the index which changes the set of processes increments the
+   generation number and records the changes under it.  All the changes
+   which happened after generation procindex_log_start are available.  */
+struct procindex_change
+{
+  unsigned long long generation;
+  pid_t pid;
+  int created;
+};
+
+static struct procindex_change procindex_log[PROCINDEX_LOG_SIZE];
+static size_t procindex_log_next;
+static unsigned long long procindex_generation;
+static unsigned long long procindex_log_start;
+
+static time_t
+procindex_now (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+static int
+procindex_compare_pids (const void *a, const void *b)
+{
+  pid_t pa = * (const pid_t *) a, pb = * (const pid_t *) b;
+
+  return pa < pb ? -1 : pa > pb;
+}
+
+/* Free the command name of an entry of the table.  */
+static void
+procindex_free_name (char *name)
+{
+  if (name)
+    memstat_free (MEMSTAT_INDEX, strlen (name) + 1);
+  free (name);
+}
+
+/* Record the creation or exit of PID in the change log.  */
+static void
+procindex_log_change (pid_t pid, int created)
+{
+  struct procindex_change *c = &procindex_log[procindex_log_next];
+
+  if (c->generation > procindex_log_start)
+    procindex_log_start = c->generation;
+
+  c->generation = procindex_generation + 1;
+  c->pid = pid;
+  c->created = created;
+  procindex_log_next = (procindex_log_next + 1) % PROCINDEX_LOG_SIZE;
+}
+
+/* Update the index to cover exactly the NUM_PIDS processes in PIDS.  The
+   index must be locked.  */
+static error_t
+procindex_merge (const pid_t *pids, size_t num_pids)
+{
+  struct procindex_entry *entries;
+  const pid_t *sorted;
+  pid_t *copy = NULL;
+  size_t i, j, n;
+  int first = ! procindex_entries, changed = 0, in_order = 1, same;
+
+  /* The proc server lists the processes in order, and most of the time
+     they are the same as last time, in which case there is nothing to
+     do.  */
+  same = ! first && num_pids == procindex_num_entries;
+  for (i = 0; i < num_pids && in_order; i++)
+    {
+      in_order = i == 0 || pids[i - 1] < pids[i];
+      same = same && procindex_entries[i].pid == pids[i];
+    }
+
+  if (in_order && same)
+    {
+      procindex_pids_refreshed = procindex_now ();
+      return 0;
+    }
+
+  if (in_order)
+    sorted = pids;
+  else
+    {
+      sorted = copy = malloc ((num_pids ?: 1) * sizeof *copy);
+      if (! copy)
+	return ENOMEM;
+
+      memcpy (copy, pids, num_pids * sizeof *copy);
+      qsort (copy, num_pids, sizeof *copy, procindex_compare_pids);
+    }
+
+  entries = malloc ((num_pids ?: 1) * sizeof *entries);
+  if (! entries)
+    {
+      free (copy);
+      return ENOMEM;
+    }
+
+  for (i = 0, j = 0, n = 0; i < num_pids; i++)
+    {
+      if (i > 0 && sorted[i] == sorted[i - 1])
+	continue;
+
+      /* Drop the processes which have disappeared.  */
+      while (j < procindex_num_entries && procindex_entries[j].pid < sorted[i])
+	{
+	  procindex_log_change (procindex_entries[j].pid, 0);
+	  procindex_free_name (procindex_entries[j++].name);
+	  changed = 1;
+	}
+
+      if (j < procindex_num_entries && procindex_entries[j].pid == sorted[i])
+	entries[n++] = procindex_entries[j++];
+      else
+	{
+	  /* Don't log the whole process list when it is first retrieved.  */
+	  if (! first)
+	    procindex_log_change (sorted[i], 1);
+	  entries[n++] = (struct procindex_entry) {
+	    .pid = sorted[i],
+	    .owner = -1,
+	    .ppid = -1,
+	  };
+	  changed = 1;
+	}
+    }
+
+  while (j < procindex_num_entries)
+    {
+      procindex_log_change (procindex_entries[j].pid, 0);
+      procindex_free_name (procindex_entries[j++].name);
+      changed = 1;
+    }
+
+  if (first)
+    procindex_log_start = procindex_generation + 1;
+  if (first || changed)
+    procindex_generation++;
+
+  if (procindex_entries)
+    memstat_free (MEMSTAT_INDEX, procindex_entries_size);
+  free (procindex_entries);
+  procindex_entries = entries;
+  procindex_entries_size = (num_pids ?: 1) * sizeof *entries;
+  procindex_num_entries = n;
+  memstat_alloc (MEMSTAT_INDEX, procindex_entries_size);
+  procindex_pids_refreshed = procindex_now ();
+
+  free (copy);
+  return 0;
+}
+
+/* Fetch the attributes designated by FLAGS for ENTRY, which is not part
+   of the table.  */
+static void
+procindex_fetch (struct ps_context *pc, struct procindex_entry *entry,
+		 ps_flags_t flags)
+{
+  struct proc_stat *ps;
+  const char *fn;
+  int owner;
+
+  if (_proc_stat_create (entry->pid, pc, &ps))
+    return;
+
+  proc_stat_set_flags (ps, flags);
+
+  if ((flags & PSTAT_OWNER_UID) && (proc_stat_flags (ps) & PSTAT_OWNER_UID))
+    {
+      owner = proc_stat_owner_uid (ps);
+      entry->owner = owner >= 0 ? owner : opt_anon_owner;
+    }
+
+  if ((flags & PSTAT_PROC_INFO) && (proc_stat_flags (ps) & PSTAT_PROC_INFO))
+    entry->ppid = proc_stat_proc_info (ps)->ppid;
+
+  if (flags & PSTAT_ARGS)
+    {
+      if (proc_stat_flags (ps) & PSTAT_ARGS)
+	{
+	  fn = args_filename (proc_stat_args (ps));
+	  entry->name = strndup (fn, args_filename_length (fn));
+	}
+      else
+	entry->name = strdup ("");
+    }
+
+  _proc_stat_free (ps);
+}
+
+/* Tell whether the value of KEY has been retrieved for ENTRY.  */
+static int
+procindex_known (enum procindex_key key, const struct procindex_entry *entry)
+{
+  switch (key)
+    {
+    case PROCINDEX_OWNER:
+      return entry->owner >= 0;
+    case PROCINDEX_PARENT:
+      return entry->ppid >= 0;
+    case PROCINDEX_NAME:
+      return entry->name != NULL;
+    }
+
+  assert (! "unknown index key");
+  return 0;
+}
+
+/* Fetch the value of KEY, using the libps FLAGS, for the entries where it
+   is not known yet.  If REFRESHED is not NULL, the value can change over
+   the lifetime of a process and is fetched again for all the entries
+   when *REFRESHED is older than PROCINDEX_TTL.  */
+static error_t
+procindex_refresh_key (struct ps_context *pc, enum procindex_key key,
+		       ps_flags_t flags, time_t *refreshed, time_t now)
+{
+  struct procindex_entry *fetched, *entry;
+  size_t i, n;
+  int all;
+
+  /* Find out which processes need to be queried.  */
+  pthread_mutex_lock (&procindex_lock);
+  all = refreshed && now - *refreshed >= PROCINDEX_TTL;
+  fetched = malloc ((procindex_num_entries ?: 1) * sizeof *fetched);
+  for (i = n = 0; fetched && i < procindex_num_entries; i++)
+    if (all || ! procindex_known (key, &procindex_entries[i]))
+      fetched[n++] = (struct procindex_entry) {
+	.pid = procindex_entries[i].pid,
+	.owner = -1,
+	.ppid = -1,
+      };
+  pthread_mutex_unlock (&procindex_lock);
+
+  if (! fetched)
+    return ENOMEM;
+
+  for (i = 0; i < n; i++)
+    procindex_fetch (pc, &fetched[i], flags);
+
+  /* Merge the results into the table, where the processes which exited
+     in the meantime can't be found anymore.  */
+  pthread_mutex_lock (&procindex_lock);
+  for (i = 0; i < n; i++)
+    {
+      entry = bsearch (&fetched[i].pid, procindex_entries,
+		       procindex_num_entries, sizeof *procindex_entries,
+		       procindex_compare_pids);
+      if (! entry)
+	continue;
+
+      if (fetched[i].owner >= 0)
+	entry->owner = fetched[i].owner;
+      if (fetched[i].ppid >= 0)
+	entry->ppid = fetched[i].ppid;
+      /* Keep the previous name if the new one could not be retrieved.  */
+      if (fetched[i].name
+	  && (! entry->name
+	      || (fetched[i].name[0] && strcmp (entry->name, fetched[i].name))))
+	{
+	  procindex_free_name (entry->name);
+	  entry->name = fetched[i].name;
+	  fetched[i].name = NULL;
+	  memstat_alloc (MEMSTAT_INDEX, strlen (entry->name) + 1);
+	}
+    }
+  if (all)
+    *refreshed = now;
+  pthread_mutex_unlock (&procindex_lock);
+
+  for (i = 0; i < n; i++)
+    free (fetched[i].name);
+  free (fetched);
+  return 0;
+}
+
+/* Make sure the list of processes is reasonably recent.  */
+static error_t
+procindex_refresh_pids (struct ps_context *pc, time_t now)
+{
+  pidarray_t pids;
+  mach_msg_type_number_t num_pids;
+  error_t err;
+  int fresh;
+
+  pthread_mutex_lock (&procindex_lock);
+  fresh = procindex_entries && now - procindex_pids_refreshed < PROCINDEX_TTL;
+  pthread_mutex_unlock (&procindex_lock);
+
+  if (fresh)
+    return 0;
+
+  num_pids = 0;
+  err = proc_getallpids (pc->server, &pids, &num_pids);
+  if (err)
+    return EIO;
+
+  pthread_mutex_lock (&procindex_lock);
+  err = procindex_merge (pids, num_pids);
+  pthread_mutex_unlock (&procindex_lock);
+
+  vm_deallocate (mach_task_self (), (vm_address_t) pids,
+		 num_pids * sizeof pids[0]);
+  return err;
+}
+
+/* Make sure the information about KEY is reasonably recent.  The index
+   must not be locked.  */
+static error_t
+procindex_refresh (struct ps_context *pc, enum procindex_key key)
+{
+  time_t now = procindex_now ();
+  error_t err;
+
+  pthread_mutex_lock (&procindex_refresh_lock);
+
+  err = procindex_refresh_pids (pc, now);
+  if (err)
+    {
+      pthread_mutex_unlock (&procindex_refresh_lock);
+      return err;
+    }
+
+  switch (key)
+    {
+    case PROCINDEX_OWNER:
+      err = procindex_refresh_key (pc, key, PSTAT_OWNER_UID,
+				   &procindex_owners_refreshed, now);
+      break;
+
+    case PROCINDEX_PARENT:
+      err = procindex_refresh_key (pc, key, PSTAT_PROC_INFO,
+				   &procindex_parents_refreshed, now);
+      break;
+
+    case PROCINDEX_NAME:
+      err = procindex_refresh_key (pc, key, PSTAT_ARGS,
+				   &procindex_names_refreshed, now);
+      break;
+    }
+
+  pthread_mutex_unlock (&procindex_refresh_lock);
+  return err;
+}
+
+void
+procindex_update_pids (const pid_t *pids, size_t num_pids)
+{
+  pthread_mutex_lock (&procindex_lock);
+  if (procindex_entries)
+    procindex_merge (pids, num_pids);
+  pthread_mutex_unlock (&procindex_lock);
+}
+
+error_t
+procindex_prewarm (struct ps_context *pc)
+{
+  error_t err;
+
+  pthread_mutex_lock (&procindex_lock);
+  procindex_prewarm_state = PROCINDEX_PREWARMING;
+  pthread_mutex_unlock (&procindex_lock);
+
+  pthread_mutex_lock (&procindex_refresh_lock);
+  err = procindex_refresh_pids (pc, procindex_now ());
+  pthread_mutex_unlock (&procindex_refresh_lock);
+
+  pthread_mutex_lock (&procindex_lock);
+  procindex_prewarm_state = err ? PROCINDEX_COLD : PROCINDEX_PREWARMED;
+  pthread_cond_broadcast (&procindex_prewarm_cond);
+  pthread_mutex_unlock (&procindex_lock);
+
+  return err;
+}
+
+int
+procindex_take_prewarmed (pid_t **pids, size_t *num_pids)
+{
+  int taken = 0;
+  size_t i;
+
+  pthread_mutex_lock (&procindex_lock);
+
+  /* The list being retrieved was asked for before this listing, so it
+     comes sooner than the one we would retrieve ourselves.  */
+  while (procindex_prewarm_state == PROCINDEX_PREWARMING)
+    pthread_cond_wait (&procindex_prewarm_cond, &procindex_lock);
+
+  if (procindex_prewarm_state == PROCINDEX_PREWARMED
+      && procindex_now () - procindex_pids_refreshed < PROCINDEX_TTL)
+    {
+      *pids = malloc ((procindex_num_entries ?: 1) * sizeof **pids);
+      if (*pids)
+	{
+	  for (i = 0; i < procindex_num_entries; i++)
+	    (*pids)[i] = procindex_entries[i].pid;
+	  *num_pids = procindex_num_entries;
+	  taken = 1;
+	}
+    }
+  procindex_prewarm_state = PROCINDEX_COLD;
+  pthread_mutex_unlock (&procindex_lock);
+
+  return taken;
+}
+
+/* Get the value of KEY for ENTRY as a string, or NULL if it is unknown or
+   can't be used as a file name.  BUF should have room for NUMBER_STR_SIZE
+   characters.  */
+static const char *
+procindex_value (enum procindex_key key, const struct procindex_entry *entry,
+		 char *buf)
+{
+  switch (key)
+    {
+    case PROCINDEX_OWNER:
+      if (entry->owner < 0)
+	return NULL;
+
+      sprintf (buf, "%d", entry->owner);
+      return buf;
+
+    case PROCINDEX_PARENT:
+      if (entry->ppid < 0)
+	return NULL;
+
+      sprintf (buf, "%d", entry->ppid);
+      return buf;
+
+    case PROCINDEX_NAME:
+      /* argv[0] can contain anything, but a file name can't contain a
+	 slash, and the strings end at the first null byte anyway.  */
+      if (! entry->name || ! entry->name[0] || strchr (entry->name, '/')
+	  || ! strcmp (entry->name, ".") || ! strcmp (entry->name, ".."))
+	return NULL;
+
+      return entry->name;
+    }
+
+  assert (! "unknown index key");
+  return NULL;
+}
+
+/* Tell whether the value of KEY for ENTRY is VALUE.  */
+static int
+procindex_match (enum procindex_key key, const struct procindex_entry *entry,
+		 const char *value)
+{
+  char buf[NUMBER_STR_SIZE];
+  const char *v = procindex_value (key, entry, buf);
+
+  return v && ! strcmp (v, value);
+}
+
+/* Sort the entries with unknown values first.  */
+static int
+procindex_compare (const void *a, const void *b, void *arg)
+{
+  enum procindex_key key = (intptr_t) arg;
+  char bufa[NUMBER_STR_SIZE], bufb[NUMBER_STR_SIZE];
+  const char *va, *vb;
+
+  va = procindex_value (key, a, bufa);
+  vb = procindex_value (key, b, bufb);
+  if (! va || ! vb)
+    return !! va - !! vb;
+
+  return strcmp (va, vb);
+}
+
+
+/* Directories of PIDs, such as by-uid/[uid] or by-name/[name] */
+
+struct procindex_subdir
+{
+  struct ps_context *pc;
+  enum procindex_key key;
+  char value[0];
+};
+
+static void
+procindex_subdir_cleanup (void *hook)
+{
+  struct procindex_subdir *dir = hook;
+
+  memstat_free (MEMSTAT_DIRS, sizeof *dir + strlen (dir->value) + 1);
+  free (dir);
+}
+
+static error_t
+procindex_subdir_get_contents (void *hook, char **contents,
+			       ssize_t *contents_len)
+{
+  static const char dot_dotdot[] = ".\0..";
+  struct procindex_subdir *dir = hook;
+  size_t i, pos;
+  error_t err;
+
+  err = procindex_refresh (dir->pc, dir->key);
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&procindex_lock);
+
+  *contents = malloc (sizeof dot_dotdot
+		      + procindex_num_entries * NUMBER_STR_SIZE);
+  if (! *contents)
+    {
+      pthread_mutex_unlock (&procindex_lock);
+      return ENOMEM;
+    }
+
+  memcpy (*contents, dot_dotdot, sizeof dot_dotdot);
+  pos = sizeof dot_dotdot;
+  for (i = 0; i < procindex_num_entries; i++)
+    {
+      struct procindex_entry *entry = &procindex_entries[i];
+
+      if (procindex_match (dir->key, entry, dir->value))
+	pos += sprintf (*contents + pos, "%d", entry->pid) + 1;
+    }
+
+  pthread_mutex_unlock (&procindex_lock);
+
+  *contents_len = pos;
+  return 0;
+}
+
+/* The symlinks to the [pid] directories hold their target as a hook.  */
+static error_t
+procindex_link_get_contents (void *hook, char **contents,
+			     ssize_t *contents_len)
+{
+  *contents = hook;
+  *contents_len = strlen (hook);
+  return 0;
+}
+
+static error_t
+procindex_subdir_lookup (void *hook, const char *name, struct node **np)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = procindex_link_get_contents,
+    .cleanup = free,
+  };
+  struct procindex_subdir *dir = hook;
+  char buf[NUMBER_STR_SIZE];
+  char *target;
+  error_t err;
+  size_t i;
+  int found;
+
+  err = procindex_refresh (dir->pc, dir->key);
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&procindex_lock);
+  for (i = 0, found = 0; ! found && i < procindex_num_entries; i++)
+    {
+      struct procindex_entry *entry = &procindex_entries[i];
+
+      snprintf (buf, sizeof buf, "%d", entry->pid);
+      found = ! strcmp (buf, name)
+	      && procindex_match (dir->key, entry, dir->value);
+    }
+  pthread_mutex_unlock (&procindex_lock);
+
+  if (! found)
+    return ENOENT;
+
+  if (asprintf (&target, "../../%s", name) < 0)
+    return ENOMEM;
+
+  *np = procfs_make_node (&ops, target);
+  if (! *np)
+    return ENOMEM;
+
+  procfs_node_chtype (*np, S_IFLNK);
+  return 0;
+}
+
+static unsigned char
+procindex_subdir_get_dirent_type (void *hook, const char *name)
+{
+  return DT_LNK;
+}
+
+
+/* Directories of values, such as by-uid or by-name */
+
+struct procindex_dir
+{
+  struct ps_context *pc;
+  enum procindex_key key;
+};
+
+static void
+procindex_cleanup (void *hook)
+{
+  struct procindex_dir *dir = hook;
+
+  memstat_free (MEMSTAT_DIRS, sizeof *dir);
+  free (dir);
+}
+
+static error_t
+procindex_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  static const char dot_dotdot[] = ".\0..";
+  struct procindex_dir *dir = hook;
+  struct procindex_entry *sorted;
+  char buf[NUMBER_STR_SIZE];
+  const char *value, *prev;
+  size_t i, len;
+  FILE *m;
+  error_t err;
+
+  err = procindex_refresh (dir->pc, dir->key);
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&procindex_lock);
+
+  /* List each distinct value once, by sorting a copy of the index.  */
+  sorted = malloc ((procindex_num_entries ?: 1) * sizeof *sorted);
+  if (! sorted)
+    {
+      err = ENOMEM;
+      goto out;
+    }
+
+  memcpy (sorted, procindex_entries, procindex_num_entries * sizeof *sorted);
+  qsort_r (sorted, procindex_num_entries, sizeof *sorted, procindex_compare,
+	   (void *) (intptr_t) dir->key);
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    {
+      free (sorted);
+      err = ENOMEM;
+      goto out;
+    }
+
+  fwrite (dot_dotdot, 1, sizeof dot_dotdot, m);
+  for (i = 0, prev = NULL; i < procindex_num_entries; i++)
+    {
+      char prevbuf[NUMBER_STR_SIZE];
+
+      if (i > 0)
+	prev = procindex_value (dir->key, &sorted[i - 1], prevbuf);
+
+      value = procindex_value (dir->key, &sorted[i], buf);
+      if (value && (! prev || strcmp (prev, value)))
+	fwrite (value, 1, strlen (value) + 1, m);
+    }
+
+  fclose (m);
+  free (sorted);
+  *contents_len = len;
+
+out:
+  pthread_mutex_unlock (&procindex_lock);
+  return err;
+}
+
+static error_t
+procindex_lookup (void *hook, const char *name, struct node **np)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = procindex_subdir_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+    .lookup = procindex_subdir_lookup,
+    .cleanup = procindex_subdir_cleanup,
+    .get_dirent_type = procindex_subdir_get_dirent_type,
+  };
+  struct procindex_dir *dir = hook;
+  struct procindex_subdir *subdir;
+  error_t err;
+  size_t i;
+  int found;
+
+  err = procindex_refresh (dir->pc, dir->key);
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&procindex_lock);
+  for (i = 0, found = 0; ! found && i < procindex_num_entries; i++)
+    found = procindex_match (dir->key, &procindex_entries[i], name);
+  pthread_mutex_unlock (&procindex_lock);
+
+  if (! found)
+    return ENOENT;
+
+  subdir = malloc (sizeof *subdir + strlen (name) + 1);
+  if (! subdir)
+    return ENOMEM;
+
+  subdir->pc = dir->pc;
+  subdir->key = dir->key;
+  strcpy (subdir->value, name);
+  memstat_alloc (MEMSTAT_DIRS, sizeof *subdir + strlen (name) + 1);
+
+  *np = procfs_make_node (&ops, subdir);
+  if (! *np)
+    return ENOMEM;
+
+  return 0;
+}
+
+static unsigned char
+procindex_get_dirent_type (void *hook, const char *name)
+{
+  return DT_DIR;
+}
+
+struct node *
+procindex_make_node (struct ps_context *pc, enum procindex_key key)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = procindex_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+    .lookup = procindex_lookup,
+    .cleanup = procindex_cleanup,
+    .get_dirent_type = procindex_get_dirent_type,
+  };
+  struct procindex_dir *dir;
+
+  dir = malloc (sizeof *dir);
+  if (! dir)
+    return NULL;
+
+  dir->pc = pc;
+  dir->key = key;
+  memstat_alloc (MEMSTAT_DIRS, sizeof *dir);
+
+  return procfs_make_node (&ops, dir);
+}
+
+
+/* The process tree, as one line per parent process: "PPID: PID PID...".  */
+
+static int
+procindex_compare_parents (const void *a, const void *b)
+{
+  const struct procindex_entry *ea = a, *eb = b;
+
+  if (ea->ppid != eb->ppid)
+    return ea->ppid < eb->ppid ? -1 : 1;
+
+  return ea->pid < eb->pid ? -1 : ea->pid > eb->pid;
+}
+
+static error_t
+procindex_tree_get_contents (void *hook, char **contents,
+			     ssize_t *contents_len)
+{
+  struct ps_context *pc = hook;
+  struct procindex_entry *sorted;
+  size_t i, len;
+  FILE *m;
+  error_t err;
+
+  err = procindex_refresh (pc, PROCINDEX_PARENT);
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&procindex_lock);
+
+  sorted = malloc ((procindex_num_entries ?: 1) * sizeof *sorted);
+  if (! sorted)
+    {
+      err = ENOMEM;
+      goto out;
+    }
+
+  memcpy (sorted, procindex_entries, procindex_num_entries * sizeof *sorted);
+  qsort (sorted, procindex_num_entries, sizeof *sorted,
+	 procindex_compare_parents);
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    {
+      free (sorted);
+      err = ENOMEM;
+      goto out;
+    }
+
+  for (i = 0; i < procindex_num_entries; i++)
+    {
+      if (sorted[i].ppid < 0)
+	continue;
+
+      if (i == 0 || sorted[i].ppid != sorted[i - 1].ppid)
+	fprintf (m, "%s%d:", i > 0 && sorted[i - 1].ppid >= 0 ? "\n" : "",
+		 sorted[i].ppid);
+
+      fprintf (m, " %d", sorted[i].pid);
+    }
+  if (procindex_num_entries && sorted[procindex_num_entries - 1].ppid >= 0)
+    fputc ('\n', m);
+
+  fclose (m);
+  free (sorted);
+  *contents_len = len;
+
+out:
+  pthread_mutex_unlock (&procindex_lock);
+  return err;
+}
+
+struct node *
+procindex_make_tree_node (struct ps_context *pc)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = procindex_tree_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, pc);
+}
+
+
+/* The change feed.  Reading it yields a "generation N" line, where N
+   identifies the current state of the process list, followed by a "+PID"
+   or "-PID" line for each process which was created or exited since the
+   generation last written to the file by the client.  Until a generation
+   is written, or when it is too old for the changes since then to still
+   be known, a "reset" line is given instead, followed by a "+PID" line
+   for each current process.  Each lookup creates a new node, so that the
+   generation acknowledged by the client is private to it.  */
+
+struct procindex_feed
+{
+  struct ps_context *pc;
+
+  /* The last generation acknowledged by the client, or zero.  */
+  unsigned long long acked;
+};
+
+static error_t
+procindex_feed_get_contents (void *hook, char **contents,
+			     ssize_t *contents_len)
+{
+  struct procindex_feed *feed = hook;
+  size_t i, len;
+  FILE *m;
+  error_t err;
+
+  pthread_mutex_lock (&procindex_refresh_lock);
+  err = procindex_refresh_pids (feed->pc, procindex_now ());
+  pthread_mutex_unlock (&procindex_refresh_lock);
+  if (err)
+    return err;
+
+  pthread_mutex_lock (&procindex_lock);
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    {
+      err = ENOMEM;
+      goto out;
+    }
+
+  fprintf (m, "generation %llu\n", procindex_generation);
+
+  if (feed->acked && feed->acked >= procindex_log_start)
+    for (i = 0; i < PROCINDEX_LOG_SIZE; i++)
+      {
+	/* Go through the ring from the oldest change.  */
+	struct procindex_change *c
+	  = &procindex_log[(procindex_log_next + i) % PROCINDEX_LOG_SIZE];
+
+	if (c->generation > feed->acked)
+	  fprintf (m, "%c%d\n", c->created ? '+' : '-', c->pid);
+      }
+  else
+    {
+      fputs ("reset\n", m);
+      for (i = 0; i < procindex_num_entries; i++)
+	fprintf (m, "+%d\n", procindex_entries[i].pid);
+    }
+
+  fclose (m);
+  *contents_len = len;
+
+out:
+  pthread_mutex_unlock (&procindex_lock);
+  return err;
+}
+
+static void
+procindex_feed_cleanup (void *hook)
+{
+  struct procindex_feed *feed = hook;
+
+  memstat_free (MEMSTAT_DIRS, sizeof *feed);
+  free (feed);
+}
+
+/* Acknowledge the generation written by the client.  */
+static error_t
+procindex_feed_write (void *hook, struct iouser *user, const char *data,
+		      size_t *len)
+{
+  struct procindex_feed *feed = hook;
+  unsigned long long generation;
+  char buf[NUMBER_STR_SIZE], *end;
+
+  if (*len >= sizeof buf)
+    return EINVAL;
+
+  memcpy (buf, data, *len);
+  buf[*len] = '\0';
+
+  generation = strtoull (buf, &end, 10);
+  if (end == buf || (*end && strcmp (end, "\n")))
+    return EINVAL;
+
+  pthread_mutex_lock (&procindex_lock);
+  if (generation > procindex_generation)
+    {
+      pthread_mutex_unlock (&procindex_lock);
+      return EINVAL;
+    }
+  pthread_mutex_unlock (&procindex_lock);
+
+  feed->acked = generation;
+  return 0;
+}
+
+struct node *
+procindex_make_feed_node (struct ps_context *pc)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = procindex_feed_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+    .write = procindex_feed_write,
+    .cleanup = procindex_feed_cleanup,
+  };
+  struct procindex_feed *feed;
+  struct node *np;
+
+  feed = calloc (1, sizeof *feed);
+  if (! feed)
+    return NULL;
+
+  feed->pc = pc;
+  memstat_alloc (MEMSTAT_DIRS, sizeof *feed);
+
+  np = procfs_make_node (&ops, feed);
+  if (np)
+    procfs_node_chmod (np, 0666);
+
+  return np;
+}
@@ -0,0 +1,69 @@
+/* Hurd /proc filesystem, indexes of the processes by attribute.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <ps.h>
+
+/* The attributes the processes can be indexed by.  */
+enum procindex_key
+{
+  PROCINDEX_OWNER,
+  PROCINDEX_PARENT,
+  PROCINDEX_NAME,
+};
+
+/* Create a directory listing the values taken by KEY among the processes
+   published by the proc server referenced by the libps context PC.  Each
+   of them is a directory of symlinks to the corresponding [pid]
+   directories.  */
+struct node *
+procindex_make_node (struct ps_context *pc, enum procindex_key key);
+
+/* Create a file describing the tree of the processes published by the
+   proc server referenced by PC.  It has one line per parent process, made
+   of its PID, a colon and the PIDs of its children.  */
+struct node *
+procindex_make_tree_node (struct ps_context *pc);
+
+/* Create a feed of the processes created and exited since the last
+   generation acknowledged by the client.  Each node remembers its own
+   generation, so a new one should be created for each lookup.  */
+struct node *
+procindex_make_feed_node (struct ps_context *pc);
+
+/* Update the index with the list of the NUM_PIDS processes in PIDS, as
+   just retrieved from the proc server, so that it doesn't have to be
+   retrieved again for the index.  Nothing is done until the index has
+   been used.  */
+void
+procindex_update_pids (const pid_t *pids, size_t num_pids);
+
+/* Retrieve the list of the processes published by the proc server
+   referenced by PC in advance, so that the first index to be used only
+   has to fetch their attributes.  */
+error_t
+procindex_prewarm (struct ps_context *pc);
+
+/* If the list of the processes retrieved by procindex_prewarm has not
+   been taken yet and is still as recent as the indexes require, set
+   *PIDS to a malloc'd copy of it, *NUM_PIDS to its length, and return
+   nonzero.  If it is still being retrieved, wait for it.  This lets the
+   first listing of the root directory be served without asking the proc
+   server again.  */
+int
+procindex_take_prewarmed (pid_t **pids, size_t *num_pids);
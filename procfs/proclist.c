@@ -20,67 +20,110 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
 #include <mach.h>
 #include <hurd/process.h>
 #include <ps.h>
 #include "procfs.h"
 #include "process.h"
+#include "procindex.h"
 
 #define PID_STR_SIZE (3 * sizeof (pid_t) + 1)
 
+/* List the NUM_PIDS processes in PIDS as directory contents.  */
+static error_t
+proclist_format (const pid_t *pids, size_t num_pids,
+		 char **contents, ssize_t *contents_len)
+{
+  int i;
+
+  *contents = malloc (num_pids * PID_STR_SIZE);
+  if (! *contents)
+    return ENOMEM;
+
+  *contents_len = 0;
+  for (i=0; i < num_pids; i++)
+    {
+      int n = sprintf (*contents + *contents_len, "%d", pids[i]);
+      assert (n >= 0);
+      *contents_len += (n + 1);
+    }
+
+  return 0;
+}
+
 static error_t
 proclist_get_contents (void *hook, char **contents, ssize_t *contents_len)
 {
   struct ps_context *pc = hook;
   pidarray_t pids;
   mach_msg_type_number_t num_pids;
+  pid_t *prewarmed;
+  size_t num_prewarmed;
   error_t err;
-  int i;
+
+  /* With --prewarm, the process list has been retrieved while the server
+     was starting, and the first listing can use it.  */
+  if (procindex_take_prewarmed (&prewarmed, &num_prewarmed))
+    {
+      err = proclist_format (prewarmed, num_prewarmed, contents, contents_len);
+      free (prewarmed);
+      return err;
+    }
 
   num_pids = 0;
   err = proc_getallpids (pc->server, &pids, &num_pids);
   if (err)
     return EIO;
 
-  *contents = malloc (num_pids * PID_STR_SIZE);
-  if (*contents)
-    {
-      *contents_len = 0;
-      for (i=0; i < num_pids; i++)
-	{
-	  int n = sprintf (*contents + *contents_len, "%d", pids[i]);
-	  assert (n >= 0);
-	  *contents_len += (n + 1);
-	}
-    }
-  else
-    err = ENOMEM;
+  procindex_update_pids (pids, num_pids);
+  err = proclist_format (pids, num_pids, contents, contents_len);
 
   vm_deallocate (mach_task_self (), (vm_address_t) pids, num_pids * sizeof pids[0]);
   return err;
 }
 
-static error_t
-proclist_lookup (void *hook, const char *name, struct node **np)
+/* Parse NAME as a PID.  Return -1 if it does not designate a process
+   directory.  */
+static pid_t
+proclist_parse_pid (const char *name)
 {
-  struct ps_context *pc = hook;
   char *endp;
   pid_t pid;
 
-  /* Self-lookups should not end up here. */
-  assert (name[0]);
-
   /* No leading zeros allowed */
   if (name[0] == '0' && name[1])
-    return ENOENT;
+    return -1;
 
   pid = strtol (name, &endp, 10);
   if (*endp)
+    return -1;
+
+  return pid;
+}
+
+static error_t
+proclist_lookup (void *hook, const char *name, struct node **np)
+{
+  struct ps_context *pc = hook;
+  pid_t pid;
+
+  /* Self-lookups should not end up here. */
+  assert (name[0]);
+
+  pid = proclist_parse_pid (name);
+  if (pid < 0)
     return ENOENT;
 
   return process_lookup_pid (pc, pid, np);
 }
 
+static unsigned char
+proclist_get_dirent_type (void *hook, const char *name)
+{
+  return name[0] && proclist_parse_pid (name) >= 0 ? DT_DIR : DT_UNKNOWN;
+}
+
 struct node *
 proclist_make_node (struct ps_context *pc)
 {
@@ -88,6 +131,7 @@ proclist_make_node (struct ps_context *pc)
     .get_contents = proclist_get_contents,
     .lookup = proclist_lookup,
     .cleanup_contents = procfs_cleanup_contents_with_free,
+    .get_dirent_type = proclist_get_dirent_type,
   };
   return procfs_make_node (&ops, pc);
 }
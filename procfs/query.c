@@ -0,0 +1,617 @@
+/* Hurd /proc filesystem, server-side queries on the process list.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <argz.h>
+#include <mach.h>
+#include <mach/vm_param.h>
+#include <hurd/process.h>
+#include <hurd/iohelp.h>
+#include <hurd/fshelp.h>
+#include <ps.h>
+#include "procfs.h"
+#include "process.h"
+#include "query.h"
+#include "memstat.h"
+#include "main.h"
+
+/* This module implements a file which allows clients to retrieve a few
+   fields for a selection of processes in one go, rather than reading and
+   parsing the [pid]/stat file of each of them.
+
+   A query is written to the file as a list of whitespace-separated
+   words.  Words of the form FIELD=VALUE[,VALUE...] select the processes
+   for which FIELD has one of the given values, and the other words name
+   the fields to print, in order.  Reading the file then yields one line
+   per selected process, with the requested fields separated by spaces,
+   or "-" when a field is unavailable.  For instance, after writing
+   "uid=1000 pid rss state", reading the file lists the PID, resident set
+   size and state of the processes owned by UID 1000.
+
+   Each lookup creates a new node, so that the query is private to the
+   client which opened the file.  It should be opened for both reading
+   and writing, since the query is lost when the node is closed.  The
+   processes whose [pid]/stat file would not be readable by the user who
+   wrote the query are left out.
+
+   The numeric fields of all the processes are also available at once in
+   a binary, columnar form, which can be loaded without any parsing.  See
+   query_make_columns_node below.  */
+
+
+/* Fields */
+
+/* Large enough for any number printed below.  */
+#define NUMBER_STR_SIZE (3 * sizeof (long long int) + 1)
+
+struct query_field
+{
+  const char *name;
+
+  /* The proc_stat information required to get this field.  */
+  ps_flags_t needs;
+
+  /* Get the value of this field for PS, for numeric fields.  */
+  long long int (*get_number) (struct proc_stat *ps);
+
+  /* Otherwise, get the value of this field for PS as a string.  Store a
+     pointer to it in *VALUE and return its length.  The value is not
+     null-terminated, and can either point into PS or be printed into BUF,
+     which has room for NUMBER_STR_SIZE characters.  */
+  int (*get_value) (struct proc_stat *ps, char *buf, const char **value);
+};
+
+static long long int
+query_get_pid (struct proc_stat *ps)
+{
+  return proc_stat_pid (ps);
+}
+
+static long long int
+query_get_ppid (struct proc_stat *ps)
+{
+  return proc_stat_proc_info (ps)->ppid;
+}
+
+static long long int
+query_get_pgrp (struct proc_stat *ps)
+{
+  return proc_stat_proc_info (ps)->pgrp;
+}
+
+static long long int
+query_get_session (struct proc_stat *ps)
+{
+  return proc_stat_proc_info (ps)->session;
+}
+
+static long long int
+query_get_uid (struct proc_stat *ps)
+{
+  return proc_stat_owner_uid (ps);
+}
+
+static int
+query_get_state (struct proc_stat *ps, char *buf, const char **value)
+{
+  buf[0] = state_char (ps);
+  *value = buf;
+  return 1;
+}
+
+static int
+query_get_name (struct proc_stat *ps, char *buf, const char **value)
+{
+  *value = args_filename (proc_stat_args (ps));
+  return args_filename_length (*value);
+}
+
+static long long int
+query_get_threads (struct proc_stat *ps)
+{
+  return proc_stat_num_threads (ps);
+}
+
+static long long int
+query_get_vsize (struct proc_stat *ps)
+{
+  task_basic_info_t tbi = proc_stat_task_basic_info (ps);
+  return tbi->virtual_size;
+}
+
+static long long int
+query_get_rss (struct proc_stat *ps)
+{
+  task_basic_info_t tbi = proc_stat_task_basic_info (ps);
+  return tbi->resident_size / PAGE_SIZE;
+}
+
+static long long int
+query_get_utime (struct proc_stat *ps)
+{
+  thread_basic_info_t thbi = proc_stat_thread_basic_info (ps);
+  return timeval_jiffies (thbi->user_time);
+}
+
+static long long int
+query_get_stime (struct proc_stat *ps)
+{
+  thread_basic_info_t thbi = proc_stat_thread_basic_info (ps);
+  return timeval_jiffies (thbi->system_time);
+}
+
+/* The values and units are the same as in [pid]/stat.  */
+static const struct query_field query_fields[] = {
+  { "pid",	PSTAT_PID,		query_get_pid },	/* the default */
+  { "ppid",	PSTAT_PROC_INFO,	query_get_ppid },
+  { "pgrp",	PSTAT_PROC_INFO,	query_get_pgrp },
+  { "session",	PSTAT_PROC_INFO,	query_get_session },
+  { "uid",	PSTAT_OWNER_UID,	query_get_uid },
+  { "state",	PSTAT_STATE,		.get_value = query_get_state },
+  { "name",	PSTAT_ARGS,		.get_value = query_get_name },
+  { "threads",	PSTAT_NUM_THREADS,	query_get_threads },
+  { "vsize",	PSTAT_TASK_BASIC,	query_get_vsize },
+  { "rss",	PSTAT_TASK_BASIC,	query_get_rss },
+  { "utime",	PSTAT_THREAD_BASIC,	query_get_utime },
+  { "stime",	PSTAT_THREAD_BASIC,	query_get_stime },
+  {}
+};
+
+static const struct query_field *
+query_find_field (const char *name)
+{
+  const struct query_field *field;
+
+  for (field = query_fields; field->name; field++)
+    if (! strcmp (field->name, name))
+      return field;
+
+  return NULL;
+}
+
+/* Get the value of FIELD for PS as a string, as the get_value callback.  */
+static int
+query_field_value (const struct query_field *field, struct proc_stat *ps,
+		   char *buf, const char **value)
+{
+  if (! field->get_number)
+    return field->get_value (ps, buf, value);
+
+  *value = buf;
+  return sprintf (buf, "%lld", field->get_number (ps));
+}
+
+
+/* Queries */
+
+#define QUERY_MAX_FIELDS 32
+
+struct query_filter
+{
+  const struct query_field *field;
+
+  /* The accepted values, as an argz vector.  */
+  char *values;
+  size_t values_len;
+};
+
+struct query_node
+{
+  struct ps_context *pc;
+
+  /* The user who wrote the current query, or NULL if there is none.  */
+  struct iouser *user;
+
+  const struct query_field *columns[QUERY_MAX_FIELDS];
+  int num_columns;
+  ps_flags_t columns_needs;
+
+  struct query_filter filters[QUERY_MAX_FIELDS];
+  int num_filters;
+  ps_flags_t filters_needs;
+};
+
+static void
+query_reset (struct query_node *q)
+{
+  int i;
+
+  for (i = 0; i < q->num_filters; i++)
+    {
+      if (q->filters[i].values)
+	memstat_free (MEMSTAT_DIRS, q->filters[i].values_len);
+      free (q->filters[i].values);
+    }
+
+  if (q->user)
+    iohelp_free_iouser (q->user);
+
+  q->user = NULL;
+  q->num_columns = q->num_filters = 0;
+  q->columns_needs = q->filters_needs = 0;
+}
+
+/* Parse the query word WORD into Q.  */
+static error_t
+query_parse_word (struct query_node *q, char *word)
+{
+  const struct query_field *field;
+  struct query_filter *filter;
+  char *eq;
+
+  eq = strchr (word, '=');
+  if (eq)
+    *eq = '\0';
+
+  field = query_find_field (word);
+  if (! field)
+    return EINVAL;
+
+  if (! eq)
+    {
+      if (q->num_columns >= QUERY_MAX_FIELDS)
+	return EINVAL;
+
+      q->columns[q->num_columns++] = field;
+      q->columns_needs |= field->needs;
+      return 0;
+    }
+
+  if (q->num_filters >= QUERY_MAX_FIELDS)
+    return EINVAL;
+
+  filter = &q->filters[q->num_filters];
+  if (argz_create_sep (eq + 1, ',', &filter->values, &filter->values_len))
+    return ENOMEM;
+
+  if (filter->values)
+    memstat_alloc (MEMSTAT_DIRS, filter->values_len);
+  filter->field = field;
+  q->num_filters++;
+  q->filters_needs |= field->needs;
+  return 0;
+}
+
+/* The whole query must be written at once.  It replaces the previous one
+   regardless of the file offset.  */
+static error_t
+query_write (void *hook, struct iouser *user, const char *data, size_t *len)
+{
+  struct query_node *q = hook;
+  char *buf, *word, *saveptr;
+  error_t err = 0;
+
+  buf = malloc (*len + 1);
+  if (! buf)
+    return ENOMEM;
+
+  memcpy (buf, data, *len);
+  buf[*len] = '\0';
+
+  query_reset (q);
+  for (word = strtok_r (buf, " \t\n", &saveptr);
+       word && ! err;
+       word = strtok_r (NULL, " \t\n", &saveptr))
+    err = query_parse_word (q, word);
+
+  if (! err && ! q->num_columns)
+    {
+      q->columns[q->num_columns++] = &query_fields[0];
+      q->columns_needs |= query_fields[0].needs;
+    }
+
+  if (! err)
+    err = iohelp_dup_iouser (&q->user, user);
+
+  if (err)
+    query_reset (q);
+
+  free (buf);
+  return err;
+}
+
+/* Tell whether the [pid]/stat file of PS would be readable by the user who
+   wrote the query.  */
+static int
+query_allowed (struct query_node *q, struct proc_stat *ps)
+{
+  struct stat st;
+  int owner = proc_stat_owner_uid (ps);
+
+  memset (&st, 0, sizeof st);
+  st.st_mode = S_IFREG | opt_stat_mode;
+  st.st_uid = owner >= 0 ? owner : opt_anon_owner;
+  st.st_gid = getgid ();
+
+  return fshelp_access (&st, S_IREAD, q->user) == 0;
+}
+
+static int
+query_match (struct query_node *q, struct proc_stat *ps)
+{
+  char buf[NUMBER_STR_SIZE];
+  const char *value, *v;
+  int i, len;
+
+  if (proc_stat_set_flags (ps, PSTAT_OWNER_UID | q->filters_needs))
+    return 0;
+  if ((proc_stat_flags (ps) & (PSTAT_OWNER_UID | q->filters_needs))
+      != (PSTAT_OWNER_UID | q->filters_needs))
+    return 0;
+
+  if (! query_allowed (q, ps))
+    return 0;
+
+  for (i = 0; i < q->num_filters; i++)
+    {
+      struct query_filter *filter = &q->filters[i];
+
+      len = query_field_value (filter->field, ps, buf, &value);
+      for (v = filter->values; v; v = argz_next (filter->values,
+						 filter->values_len, v))
+	if (strlen (v) == len && ! memcmp (v, value, len))
+	  break;
+
+      if (! v)
+	return 0;
+    }
+
+  return 1;
+}
+
+static void
+query_print_row (struct query_node *q, struct proc_stat *ps, FILE *m)
+{
+  char buf[NUMBER_STR_SIZE];
+  const char *value;
+  int i, len;
+
+  proc_stat_set_flags (ps, q->columns_needs);
+
+  for (i = 0; i < q->num_columns; i++)
+    {
+      const struct query_field *field = q->columns[i];
+
+      if (i)
+	fputc (' ', m);
+
+      if ((proc_stat_flags (ps) & field->needs) != field->needs)
+	{
+	  fputc ('-', m);
+	  continue;
+	}
+
+      len = query_field_value (field, ps, buf, &value);
+      fwrite (value, 1, len, m);
+    }
+
+  fputc ('\n', m);
+}
+
+static error_t
+query_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  struct query_node *q = hook;
+  struct proc_stat *ps;
+  pidarray_t pids;
+  mach_msg_type_number_t num_pids;
+  size_t len;
+  FILE *m;
+  error_t err;
+  int i;
+
+  if (! q->user)
+    {
+      *contents = NULL;
+      *contents_len = 0;
+      return 0;
+    }
+
+  num_pids = 0;
+  err = proc_getallpids (q->pc->server, &pids, &num_pids);
+  if (err)
+    return EIO;
+
+  m = open_memstream (contents, &len);
+  if (m == NULL)
+    {
+      err = ENOMEM;
+      goto out;
+    }
+
+  for (i = 0; i < num_pids; i++)
+    {
+      if (_proc_stat_create (pids[i], q->pc, &ps))
+	continue;
+
+      if (query_match (q, ps))
+	query_print_row (q, ps, m);
+
+      _proc_stat_free (ps);
+    }
+
+  fclose (m);
+  *contents_len = len;
+
+out:
+  vm_deallocate (mach_task_self (), (vm_address_t) pids,
+		 num_pids * sizeof pids[0]);
+  return err;
+}
+
+static void
+query_cleanup (void *hook)
+{
+  struct query_node *q = hook;
+
+  query_reset (q);
+  memstat_free (MEMSTAT_DIRS, sizeof *q);
+  free (q);
+}
+
+struct node *
+query_make_node (struct ps_context *pc)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = query_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+    .write = query_write,
+    .cleanup = query_cleanup,
+  };
+  struct query_node *q;
+  struct node *np;
+
+  q = calloc (1, sizeof *q);
+  if (! q)
+    return NULL;
+
+  q->pc = pc;
+  memstat_alloc (MEMSTAT_DIRS, sizeof *q);
+
+  np = procfs_make_node (&ops, q);
+  if (np)
+    procfs_node_chmod (np, 0666);
+
+  return np;
+}
+
+
+/* Columnar snapshots */
+
+/* The header of the columnar snapshot.  It is followed by the names of
+   the NUM_COLUMNS columns, each of them in a null-padded array of
+   QUERY_COLUMN_NAME_SIZE characters, then by each column in turn, as an
+   array of NUM_ROWS 64-bit integers.  All the integers are in the native
+   byte order, and a value of -1 means that the field is unavailable.  */
+struct query_columns_header
+{
+  char magic[8];		/* "PROCCOLS" */
+  uint32_t version;		/* 1 */
+  uint32_t num_rows;
+  uint32_t num_columns;
+  uint32_t reserved;
+};
+
+#define QUERY_COLUMN_NAME_SIZE 16
+
+static error_t
+query_columns_get_contents (void *hook, char **contents,
+			    ssize_t *contents_len)
+{
+  struct ps_context *pc = hook;
+  struct query_columns_header *header;
+  const struct query_field *columns[QUERY_MAX_FIELDS];
+  const struct query_field *field;
+  ps_flags_t needs = 0;
+  struct proc_stat *ps;
+  pidarray_t pids;
+  mach_msg_type_number_t num_pids;
+  int64_t *values;
+  size_t len;
+  char *names;
+  int i, j, num_columns = 0;
+  error_t err = 0;
+
+  for (field = query_fields; field->name; field++)
+    if (field->get_number)
+      {
+	columns[num_columns++] = field;
+	needs |= field->needs;
+      }
+
+  num_pids = 0;
+  err = proc_getallpids (pc->server, &pids, &num_pids);
+  if (err)
+    return EIO;
+
+  len = sizeof *header + num_columns * QUERY_COLUMN_NAME_SIZE
+    + num_columns * num_pids * sizeof *values;
+  *contents = calloc (1, len);
+  if (! *contents)
+    {
+      err = ENOMEM;
+      goto out;
+    }
+
+  header = (struct query_columns_header *) *contents;
+  memcpy (header->magic, "PROCCOLS", sizeof header->magic);
+  header->version = 1;
+  header->num_rows = num_pids;
+  header->num_columns = num_columns;
+
+  names = *contents + sizeof *header;
+  for (j = 0; j < num_columns; j++)
+    strncpy (names + j * QUERY_COLUMN_NAME_SIZE, columns[j]->name,
+	     QUERY_COLUMN_NAME_SIZE);
+
+  values = (int64_t *) (names + num_columns * QUERY_COLUMN_NAME_SIZE);
+  for (i = 0; i < num_pids; i++)
+    {
+      if (_proc_stat_create (pids[i], pc, &ps))
+	ps = NULL;
+      else
+	proc_stat_set_flags (ps, needs);
+
+      for (j = 0; j < num_columns; j++)
+	{
+	  int64_t *value = &values[j * num_pids + i];
+
+	  field = columns[j];
+	  if (ps && (proc_stat_flags (ps) & field->needs) == field->needs)
+	    *value = field->get_number (ps);
+	  else if (field->get_number == query_get_pid)
+	    *value = pids[i];
+	  else
+	    *value = -1;
+	}
+
+      if (ps)
+	_proc_stat_free (ps);
+    }
+
+  *contents_len = len;
+
+out:
+  vm_deallocate (mach_task_self (), (vm_address_t) pids,
+		 num_pids * sizeof pids[0]);
+  return err;
+}
+
+struct node *
+query_make_columns_node (struct ps_context *pc)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = query_columns_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+  struct node *np;
+
+  np = procfs_make_node (&ops, pc);
+
+  /* The columns can't be filtered according to the user reading them, so
+     only expose them as widely as the [pid]/stat files.  */
+  if (np && ! (opt_stat_mode & S_IROTH))
+    procfs_node_chmod (np, 0400);
+
+  return np;
+}
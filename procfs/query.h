@@ -0,0 +1,31 @@
+/* Hurd /proc filesystem, server-side queries on the process list.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <ps.h>
+
+/* Create a new query file for the processes published by the proc server
+   referenced by the libps context PC.  Each node holds its own query, so
+   a new one should be created for each lookup.  */
+struct node *
+query_make_node (struct ps_context *pc);
+
+/* Create a file providing the numeric fields of all the processes in a
+   binary, columnar format.  */
+struct node *
+query_make_columns_node (struct ps_context *pc);
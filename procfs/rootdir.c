@@ -27,13 +27,24 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <sys/time.h>
 #include <sys/utsname.h>
 #include <sys/stat.h>
+#include <sys/param.h>
 #include <argz.h>
 #include <ps.h>
 #include "procfs.h"
 #include "procfs_dir.h"
+#include "query.h"
+#include "procindex.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "memstat.h"
+#include "slabhist.h"
+#include "hosthist.h"
+#include "mounts.h"
+#include "prewarm.h"
 #include "main.h"
 
 #include "mach_debug_U.h"
@@ -44,16 +55,34 @@
    more complicated, not simpler.  */
 
 
+/* Upper bound on the length of any number printed by the generators.  */
+#define NUMBER_STR_SIZE (3 * sizeof (long long int) + 1)
+
+
 /* Helper functions */
 
-/* We get the boot time by using that of the kernel process. */
+/* We get the boot time by using that of the kernel process.  It never
+   changes, so it is only fetched again if --kernel-process changes.  */
 static error_t
 get_boottime (struct ps_context *pc, struct timeval *tv)
 {
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static pid_t boottime_pid = -1;
+  static struct timeval boottime;
+  pid_t pid = opt_kernel_pid;
   struct proc_stat *ps;
   error_t err;
 
-  err = _proc_stat_create (opt_kernel_pid, pc, &ps);
+  pthread_mutex_lock (&lock);
+  if (boottime_pid == pid)
+    {
+      *tv = boottime;
+      pthread_mutex_unlock (&lock);
+      return 0;
+    }
+  pthread_mutex_unlock (&lock);
+
+  err = _proc_stat_create (pid, pc, &ps);
   if (err)
     return err;
 
@@ -66,12 +95,50 @@ get_boottime (struct ps_context *pc, struct timeval *tv)
       task_basic_info_t tbi = proc_stat_task_basic_info (ps);
       tv->tv_sec = tbi->creation_time.seconds;
       tv->tv_usec = tbi->creation_time.microseconds;
+
+      pthread_mutex_lock (&lock);
+      boottime = *tv;
+      boottime_pid = pid;
+      pthread_mutex_unlock (&lock);
     }
 
   _proc_stat_free (ps);
   return err;
 }
 
+/* The basic information about the host never changes either, so it is
+   only fetched once.  */
+static error_t
+get_hostinfo (host_basic_info_t hbi)
+{
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static int hostinfo_valid;
+  static host_basic_info_data_t hostinfo;
+  mach_msg_type_number_t cnt;
+  error_t err;
+
+  pthread_mutex_lock (&lock);
+  if (hostinfo_valid)
+    {
+      *hbi = hostinfo;
+      pthread_mutex_unlock (&lock);
+      return 0;
+    }
+  pthread_mutex_unlock (&lock);
+
+  cnt = HOST_BASIC_INFO_COUNT;
+  err = host_info (mach_host_self (), HOST_BASIC_INFO, (host_info_t) hbi, &cnt);
+  if (err)
+    return err;
+
+  assert (cnt == HOST_BASIC_INFO_COUNT);
+  pthread_mutex_lock (&lock);
+  hostinfo = *hbi;
+  hostinfo_valid = 1;
+  pthread_mutex_unlock (&lock);
+  return 0;
+}
+
 /* We get the idle time by querying the kernel's idle thread. */
 static error_t
 get_idletime (struct ps_context *pc, struct timeval *tv)
@@ -262,11 +329,17 @@ rootdir_gc_loadavg (void *hook, char **contents, ssize_t *contents_len)
   return 0;
 }
 
+/* Three load averages with two decimals, followed by 7 characters.  */
+static ssize_t
+rootdir_size_loadavg (void *hook)
+{
+  return 3 * (NUMBER_STR_SIZE + 4) + 7;
+}
+
 static error_t
 rootdir_gc_meminfo (void *hook, char **contents, ssize_t *contents_len)
 {
   host_basic_info_data_t hbi;
-  mach_msg_type_number_t cnt;
   struct vm_statistics vmstats;
   struct vm_cache_statistics cache_stats;
   default_pager_info_t swap;
@@ -280,8 +353,7 @@ rootdir_gc_meminfo (void *hook, char **contents, ssize_t *contents_len)
   if (err)
     return EIO;
 
-  cnt = HOST_BASIC_INFO_COUNT;
-  err = host_info (mach_host_self (), HOST_BASIC_INFO, (host_info_t) &hbi, &cnt);
+  err = get_hostinfo (&hbi);
   if (err)
     return err;
 
@@ -289,7 +361,6 @@ rootdir_gc_meminfo (void *hook, char **contents, ssize_t *contents_len)
   if (err)
     return err;
 
-  assert (cnt == HOST_BASIC_INFO_COUNT);
   *contents_len = asprintf (contents,
       "MemTotal: %14lu kB\n"
       "MemFree:  %14lu kB\n"
@@ -314,11 +385,18 @@ rootdir_gc_meminfo (void *hook, char **contents, ssize_t *contents_len)
   return 0;
 }
 
+/* Nine lines made of a 10-character label, a number padded to 14
+   characters, and the unit.  */
+static ssize_t
+rootdir_size_meminfo (void *hook)
+{
+  return 9 * (10 + MAX (14, NUMBER_STR_SIZE) + sizeof " kB\n");
+}
+
 static error_t
 rootdir_gc_vmstat (void *hook, char **contents, ssize_t *contents_len)
 {
   host_basic_info_data_t hbi;
-  mach_msg_type_number_t cnt;
   struct vm_statistics vmstats;
   error_t err;
 
@@ -326,12 +404,10 @@ rootdir_gc_vmstat (void *hook, char **contents, ssize_t *contents_len)
   if (err)
     return EIO;
 
-  cnt = HOST_BASIC_INFO_COUNT;
-  err = host_info (mach_host_self (), HOST_BASIC_INFO, (host_info_t) &hbi, &cnt);
+  err = get_hostinfo (&hbi);
   if (err)
     return err;
 
-  assert (cnt == HOST_BASIC_INFO_COUNT);
   *contents_len = asprintf (contents,
       "nr_free_pages %lu\n"
       "nr_inactive_anon %lu\n"
@@ -359,14 +435,31 @@ rootdir_gc_vmstat (void *hook, char **contents, ssize_t *contents_len)
   return 0;
 }
 
+/* Ten lines with a number and a label, the labels totaling less than 140
+   characters.  */
+static ssize_t
+rootdir_size_vmstat (void *hook)
+{
+  return 140 + 10 * NUMBER_STR_SIZE;
+}
+
+/* Like the boot time, the command line of the kernel is only fetched
+   again if --kernel-process changes.  Each read gets its own copy, so
+   that the cached one can be replaced meanwhile.  */
+static pthread_mutex_t cmdline_lock = PTHREAD_MUTEX_INITIALIZER;
+static pid_t cmdline_pid = -1;
+static char *cmdline;
+static ssize_t cmdline_len;
+
 static error_t
-rootdir_gc_cmdline (void *hook, char **contents, ssize_t *contents_len)
+rootdir_fetch_cmdline (struct ps_context *pc, pid_t pid)
 {
-  struct ps_context *pc = hook;
   struct proc_stat *ps;
+  char *contents;
+  ssize_t len;
   error_t err;
 
-  err = _proc_stat_create (opt_kernel_pid, pc, &ps);
+  err = _proc_stat_create (pid, pc, &ps);
   if (err)
     return EIO;
 
@@ -377,23 +470,90 @@ rootdir_gc_cmdline (void *hook, char **contents, ssize_t *contents_len)
       goto out;
     }
 
-  *contents_len = proc_stat_args_len (ps);
-  *contents = malloc (*contents_len);
-  if (! *contents)
+  len = proc_stat_args_len (ps);
+  contents = malloc (len);
+  if (! contents)
     {
       err = ENOMEM;
       goto out;
     }
 
-  memcpy (*contents, proc_stat_args (ps), *contents_len);
-  argz_stringify (*contents, *contents_len, ' ');
-  (*contents)[*contents_len - 1] = '\n';
+  memcpy (contents, proc_stat_args (ps), len);
+  argz_stringify (contents, len, ' ');
+  contents[len - 1] = '\n';
+
+  pthread_mutex_lock (&cmdline_lock);
+  if (cmdline)
+    memstat_free (MEMSTAT_CONTENTS, cmdline_len);
+  free (cmdline);
+  memstat_alloc (MEMSTAT_CONTENTS, len);
+  cmdline = contents;
+  cmdline_len = len;
+  cmdline_pid = pid;
+  pthread_mutex_unlock (&cmdline_lock);
 
 out:
   _proc_stat_free (ps);
   return err;
 }
 
+static error_t
+rootdir_gc_cmdline (void *hook, char **contents, ssize_t *contents_len)
+{
+  pid_t pid = opt_kernel_pid;
+  error_t err;
+
+  pthread_mutex_lock (&cmdline_lock);
+  while (cmdline_pid != pid)
+    {
+      pthread_mutex_unlock (&cmdline_lock);
+      err = rootdir_fetch_cmdline (hook, pid);
+      if (err)
+	return err;
+      pthread_mutex_lock (&cmdline_lock);
+    }
+
+  *contents = malloc (cmdline_len);
+  if (*contents)
+    {
+      memcpy (*contents, cmdline, cmdline_len);
+      *contents_len = cmdline_len;
+    }
+  pthread_mutex_unlock (&cmdline_lock);
+
+  return *contents ? 0 : ENOMEM;
+}
+
+static ssize_t
+rootdir_size_cmdline (void *hook)
+{
+  ssize_t size;
+
+  pthread_mutex_lock (&cmdline_lock);
+  size = cmdline_pid == opt_kernel_pid ? cmdline_len : -1;
+  pthread_mutex_unlock (&cmdline_lock);
+
+  return size;
+}
+
+/* The kernel command line and version do not change after boot.  */
+static void
+rootdir_boot_mtime (struct ps_context *pc, struct timespec *mtime)
+{
+  struct timeval boottime;
+
+  if (get_boottime (pc, &boottime))
+    clock_gettime (CLOCK_REALTIME, mtime);
+  else
+    TIMEVAL_TO_TIMESPEC (&boottime, mtime);
+}
+
+static void
+rootdir_get_mtime_cmdline (void *hook, struct timespec *mtime)
+{
+  rootdir_boot_mtime (hook, mtime);
+}
+
 static int
 rootdir_fakeself_exists (void *dir_hook, const void *entry_hook)
 {
@@ -410,24 +570,17 @@ rootdir_gc_fakeself (void *hook, char **contents, ssize_t *contents_len)
 /* The mtab translator to use by default for the "mounts" node.  */
 #define MTAB_TRANSLATOR	"/hurd/mtab"
 
-static struct node *rootdir_mounts_node;
-static pthread_spinlock_t rootdir_mounts_node_lock =
-  PTHREAD_SPINLOCK_INITIALIZER;
-
+/* The node is reused by subsequent lookups thanks to the node cache of
+   the root directory, so that the active translator is kept around.
+   This also means that setting --native-mounts at runtime only takes
+   effect once the current node is no longer in use.  */
 static struct node *
 rootdir_mounts_make_node (void *dir_hook, const void *entry_hook)
 {
-  struct node *np, *prev;
-
-  pthread_spin_lock (&rootdir_mounts_node_lock);
-  np = rootdir_mounts_node;
-  pthread_spin_unlock (&rootdir_mounts_node_lock);
+  struct node *np;
 
-  if (np != NULL)
-    {
-      netfs_nref (np);
-      return np;
-    }
+  if (opt_native_mounts)
+    return mounts_make_node ();
 
   np = procfs_make_node (entry_hook, dir_hook);
   if (np == NULL)
@@ -436,18 +589,6 @@ rootdir_mounts_make_node (void *dir_hook, const void *entry_hook)
   procfs_node_chtype (np, S_IFREG | S_IPTRANS);
   procfs_node_chmod (np, 0444);
 
-  pthread_spin_lock (&rootdir_mounts_node_lock);
-  prev = rootdir_mounts_node;
-  if (rootdir_mounts_node == NULL)
-    rootdir_mounts_node = np;
-  pthread_spin_unlock (&rootdir_mounts_node_lock);
-
-  if (prev != NULL)
-    {
-      procfs_cleanup (np);
-      np = prev;
-    }
-
   return np;
 }
 
@@ -469,25 +610,70 @@ static int
 rootdir_mounts_exists (void *dir_hook, const void *entry_hook)
 {
   static int translator_exists = -1;
+  if (opt_native_mounts)
+    return 1;
   if (translator_exists == -1)
     translator_exists = access (MTAB_TRANSLATOR, F_OK|X_OK) == 0;
   return translator_exists;
 }
 
+/* The orders in which the slabinfo files list the caches.  */
+enum rootdir_slabinfo_order
+{
+  SLABINFO_UNSORTED,
+  SLABINFO_BY_TOTAL,
+  SLABINFO_BY_RECLAIMABLE,
+};
+
+/* An upper bound on the length of a line of slabinfo.  */
+#define SLABINFO_LINE_SIZE (CACHE_NAME_MAX_LEN + 9 * NUMBER_STR_SIZE)
+
+/* The memory used by the cache CI, in kilobytes.  */
+static size_t
+rootdir_slab_total (const struct cache_info *ci)
+{
+  return (ci->nr_slabs * ci->slab_size) >> 10;
+}
+
+/* The memory of the cache CI which can be reclaimed, in kilobytes.  */
+static size_t
+rootdir_slab_reclaimable (const struct cache_info *ci)
+{
+  return (ci->flags & CACHE_FLAGS_NO_RECLAIM)
+    ? 0 : (ci->nr_free_slabs * ci->slab_size) >> 10;
+}
+
+/* Sort the caches by decreasing memory usage of the kind given by ARG.  */
+static int
+rootdir_slab_compare (const void *a, const void *b, void *arg)
+{
+  const struct cache_info *ca = * (const struct cache_info **) a;
+  const struct cache_info *cb = * (const struct cache_info **) b;
+  size_t va, vb;
+
+  if (* (const enum rootdir_slabinfo_order *) arg == SLABINFO_BY_TOTAL)
+    va = rootdir_slab_total (ca), vb = rootdir_slab_total (cb);
+  else
+    va = rootdir_slab_reclaimable (ca), vb = rootdir_slab_reclaimable (cb);
+
+  return va < vb ? 1 : va > vb ? -1 : 0;
+}
+
 static error_t
 rootdir_gc_slabinfo (void *hook, char **contents, ssize_t *contents_len)
 {
+  const enum rootdir_slabinfo_order *order = hook;
   error_t err;
-  FILE *m;
   const char header[] =
     "cache                          obj slab  bufs   objs   bufs"
     "    total reclaimable\n"
     "name                  flags   size size /slab  usage  count"
     "   memory      memory\n";
   cache_info_array_t cache_info;
+  const struct cache_info **caches;
   size_t mem_usage, mem_reclaimable, mem_total, mem_total_reclaimable;
   mach_msg_type_number_t cache_info_count;
-  int i;
+  int i, n, pos;
 
   cache_info = NULL;
   cache_info_count = 0;
@@ -496,46 +682,157 @@ rootdir_gc_slabinfo (void *hook, char **contents, ssize_t *contents_len)
   if (err)
     return err;
 
-  m = open_memstream (contents, contents_len);
-  if (m == NULL)
+  /* Allocate the output at once, and write it in a single pass.  */
+  caches = malloc ((cache_info_count ?: 1) * sizeof *caches);
+  *contents = malloc (sizeof header
+		      + (cache_info_count + 1) * SLABINFO_LINE_SIZE);
+  if (! caches || ! *contents)
     {
+      free (caches);
+      free (*contents);
       err = ENOMEM;
       goto out;
     }
 
-  fprintf (m, "%s", header);
-
   mem_total = 0;
   mem_total_reclaimable = 0;
 
   for (i = 0; i < cache_info_count; i++)
     {
-      mem_usage = (cache_info[i].nr_slabs * cache_info[i].slab_size)
-	>> 10;
-      mem_total += mem_usage;
-      mem_reclaimable = (cache_info[i].flags & CACHE_FLAGS_NO_RECLAIM)
-	? 0 : (cache_info[i].nr_free_slabs
-	       * cache_info[i].slab_size) >> 10;
-      mem_total_reclaimable += mem_reclaimable;
-      fprintf (m,
-               "%-21s %04x %7zu %3zuk  %4lu %6lu %6lu %7zuk %10zuk\n",
-               cache_info[i].name, cache_info[i].flags,
-               cache_info[i].obj_size, cache_info[i].slab_size >> 10,
-               cache_info[i].bufs_per_slab, cache_info[i].nr_objs,
-               cache_info[i].nr_bufs, mem_usage, mem_reclaimable);
-    }
-
-  fprintf (m, "total: %zuk, reclaimable: %zuk\n",
-           mem_total, mem_total_reclaimable);
-
-  fclose (m);
+      caches[i] = &cache_info[i];
+      mem_total += rootdir_slab_total (&cache_info[i]);
+      mem_total_reclaimable += rootdir_slab_reclaimable (&cache_info[i]);
+    }
+
+  n = cache_info_count;
+  if (*order != SLABINFO_UNSORTED)
+    {
+      qsort_r (caches, n, sizeof *caches, rootdir_slab_compare,
+	       (void *) order);
+      if (opt_slab_top > 0 && n > opt_slab_top)
+	n = opt_slab_top;
+    }
+
+  memcpy (*contents, header, sizeof header - 1);
+  pos = sizeof header - 1;
+
+  for (i = 0; i < n; i++)
+    {
+      const struct cache_info *ci = caches[i];
+
+      mem_usage = rootdir_slab_total (ci);
+      mem_reclaimable = rootdir_slab_reclaimable (ci);
+      pos += sprintf (*contents + pos,
+		      "%-21.*s %04x %7zu %3zuk  %4lu %6lu %6lu %7zuk %10zuk\n",
+		      CACHE_NAME_MAX_LEN, ci->name, ci->flags,
+		      ci->obj_size, ci->slab_size >> 10,
+		      ci->bufs_per_slab, ci->nr_objs,
+		      ci->nr_bufs, mem_usage, mem_reclaimable);
+    }
+
+  pos += sprintf (*contents + pos, "total: %zuk, reclaimable: %zuk\n",
+		  mem_total, mem_total_reclaimable);
+
+  free (caches);
+  *contents_len = pos;
 
  out:
   vm_deallocate (mach_task_self (),
                  cache_info, cache_info_count * sizeof *cache_info);
   return err;
 }
-
+
+static struct node *
+rootdir_slabinfo_make_node (void *dir_hook, const void *entry_hook)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = rootdir_gc_slabinfo,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  /* The entry hook designates the order of the caches.  */
+  return procfs_make_node (&ops, (void *) entry_hook);
+}
+
+static struct node *
+rootdir_slabgrowth_make_node (void *dir_hook, const void *entry_hook)
+{
+  return slabhist_make_node ();
+}
+
+static struct node *
+rootdir_hosthistory_make_node (void *dir_hook, const void *entry_hook)
+{
+  return hosthist_make_node ();
+}
+
+static struct node *
+rootdir_pressure_make_node (void *dir_hook, const void *entry_hook)
+{
+  return hosthist_make_pressure_node ();
+}
+
+static struct node *
+rootdir_paging_make_node (void *dir_hook, const void *entry_hook)
+{
+  return hosthist_make_paging_node ();
+}
+
+static struct node *
+rootdir_columns_make_node (void *dir_hook, const void *entry_hook)
+{
+  return query_make_columns_node (dir_hook);
+}
+
+static struct node *
+rootdir_snapshot_make_node (void *dir_hook, const void *entry_hook)
+{
+  return snapshot_make_node ();
+}
+
+static struct node *
+rootdir_trace_make_node (void *dir_hook, const void *entry_hook)
+{
+  return trace_make_node ();
+}
+
+static struct node *
+rootdir_memstat_make_node (void *dir_hook, const void *entry_hook)
+{
+  return memstat_make_node ();
+}
+
+static struct node *
+rootdir_prewarm_make_node (void *dir_hook, const void *entry_hook)
+{
+  return prewarm_make_node ();
+}
+
+static struct node *
+rootdir_query_make_node (void *dir_hook, const void *entry_hook)
+{
+  return query_make_node (dir_hook);
+}
+
+static struct node *
+rootdir_proctree_make_node (void *dir_hook, const void *entry_hook)
+{
+  return procindex_make_tree_node (dir_hook);
+}
+
+static struct node *
+rootdir_changes_make_node (void *dir_hook, const void *entry_hook)
+{
+  return procindex_make_feed_node (dir_hook);
+}
+
+static struct node *
+rootdir_byindex_make_node (void *dir_hook, const void *entry_hook)
+{
+  const enum procindex_key *key = entry_hook;
+  return procindex_make_node (dir_hook, *key);
+}
+
 /* Glue logic and entries table */
 
 static struct node *
@@ -557,6 +854,97 @@ rootdir_symlink_make_node (void *dir_hook, const void *entry_hook)
   return np;
 }
 
+/* Some files never change while we're running.  Their contents are
+   generated only once, the first time they are read, and the resulting
+   buffer is shared by all the corresponding nodes from then on.  The
+   entry hook for these files is a rootdir_static_file structure, which
+   is also used as the hook of the nodes.  */
+struct rootdir_static_file
+{
+  /* The content generator, invoked with the ps_context as its hook.  */
+  error_t (*get_contents) (void *hook, char **contents, ssize_t *contents_len);
+
+  pthread_mutex_t lock;
+  struct ps_context *pc;
+  char *contents;
+  ssize_t contents_len;
+};
+
+static error_t
+rootdir_static_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  struct rootdir_static_file *file = hook;
+  error_t err = 0;
+
+  pthread_mutex_lock (&file->lock);
+  if (! file->contents)
+    {
+      char *c;
+      ssize_t len = -1;
+
+      err = file->get_contents (file->pc, &c, &len);
+      if (! err && len < 0)
+	err = ENOMEM;
+      if (! err)
+	{
+	  file->contents = c;
+	  file->contents_len = len;
+	  memstat_alloc (MEMSTAT_CONTENTS, len);
+	}
+    }
+  pthread_mutex_unlock (&file->lock);
+
+  if (err)
+    return err;
+
+  *contents = file->contents;
+  *contents_len = file->contents_len;
+  return 0;
+}
+
+static ssize_t
+rootdir_static_estimate_size (void *hook)
+{
+  struct rootdir_static_file *file = hook;
+  ssize_t size;
+
+  pthread_mutex_lock (&file->lock);
+  size = file->contents ? file->contents_len : -1;
+  pthread_mutex_unlock (&file->lock);
+
+  return size;
+}
+
+static void
+rootdir_static_get_mtime (void *hook, struct timespec *mtime)
+{
+  struct rootdir_static_file *file = hook;
+  struct ps_context *pc;
+
+  pthread_mutex_lock (&file->lock);
+  pc = file->pc;
+  pthread_mutex_unlock (&file->lock);
+
+  rootdir_boot_mtime (pc, mtime);
+}
+
+static struct node *
+rootdir_static_make_node (void *dir_hook, const void *entry_hook)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = rootdir_static_get_contents,
+    .estimate_size = rootdir_static_estimate_size,
+    .get_mtime = rootdir_static_get_mtime,
+  };
+  struct rootdir_static_file *file = (struct rootdir_static_file *) entry_hook;
+
+  pthread_mutex_lock (&file->lock);
+  file->pc = dir_hook;
+  pthread_mutex_unlock (&file->lock);
+
+  return procfs_make_node (&ops, file);
+}
+
 static const struct procfs_dir_entry rootdir_entries[] = {
   {
     .name = "self",
@@ -567,14 +955,18 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .ops = {
       .make_node = rootdir_symlink_make_node,
       .exists = rootdir_fakeself_exists,
+      .type = DT_LNK,
     }
   },
   {
     .name = "version",
-    .hook = & (struct procfs_node_ops) {
+    .hook = & (struct rootdir_static_file) {
       .get_contents = rootdir_gc_version,
-      .cleanup_contents = procfs_cleanup_contents_with_free,
+      .lock = PTHREAD_MUTEX_INITIALIZER,
     },
+    .ops = {
+      .make_node = rootdir_static_make_node,
+    }
   },
   {
     .name = "uptime",
@@ -595,6 +987,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_loadavg,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .estimate_size = rootdir_size_loadavg,
     },
   },
   {
@@ -602,6 +995,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_meminfo,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .estimate_size = rootdir_size_meminfo,
     },
   },
   {
@@ -609,6 +1003,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_vmstat,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .estimate_size = rootdir_size_vmstat,
     },
   },
   {
@@ -616,6 +1011,8 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_cmdline,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .estimate_size = rootdir_size_cmdline,
+      .get_mtime = rootdir_get_mtime_cmdline,
     },
   },
   {
@@ -630,10 +1027,117 @@ static const struct procfs_dir_entry rootdir_entries[] = {
   },
   {
     .name = "slabinfo",
-    .hook = & (struct procfs_node_ops) {
-      .get_contents = rootdir_gc_slabinfo,
-      .cleanup_contents = procfs_cleanup_contents_with_free,
-    },
+    .hook = & (enum rootdir_slabinfo_order) { SLABINFO_UNSORTED },
+    .ops = {
+      .make_node = rootdir_slabinfo_make_node,
+    }
+  },
+  {
+    .name = "slabinfo-by-total",
+    .hook = & (enum rootdir_slabinfo_order) { SLABINFO_BY_TOTAL },
+    .ops = {
+      .make_node = rootdir_slabinfo_make_node,
+    }
+  },
+  {
+    .name = "slabinfo-by-reclaimable",
+    .hook = & (enum rootdir_slabinfo_order) { SLABINFO_BY_RECLAIMABLE },
+    .ops = {
+      .make_node = rootdir_slabinfo_make_node,
+    }
+  },
+  {
+    .name = "slabgrowth",
+    .ops = {
+      .make_node = rootdir_slabgrowth_make_node,
+    }
+  },
+  {
+    .name = "hosthistory",
+    .ops = {
+      .make_node = rootdir_hosthistory_make_node,
+    }
+  },
+  {
+    .name = "pressure",
+    .ops = {
+      .make_node = rootdir_pressure_make_node,
+      .type = DT_DIR,
+    }
+  },
+  {
+    .name = "paging",
+    .ops = {
+      .make_node = rootdir_paging_make_node,
+    }
+  },
+  {
+    .name = "by-uid",
+    .hook = & (enum procindex_key) { PROCINDEX_OWNER },
+    .ops = {
+      .make_node = rootdir_byindex_make_node,
+      .type = DT_DIR,
+    }
+  },
+  {
+    .name = "by-name",
+    .hook = & (enum procindex_key) { PROCINDEX_NAME },
+    .ops = {
+      .make_node = rootdir_byindex_make_node,
+      .type = DT_DIR,
+    }
+  },
+  {
+    .name = "proctree",
+    .ops = {
+      .make_node = rootdir_proctree_make_node,
+    }
+  },
+  {
+    .name = "changes",
+    .ops = {
+      .make_node = rootdir_changes_make_node,
+      .private_nodes = 1,
+    }
+  },
+  {
+    .name = "columns",
+    .ops = {
+      .make_node = rootdir_columns_make_node,
+    }
+  },
+  {
+    .name = "query",
+    .ops = {
+      .make_node = rootdir_query_make_node,
+      .private_nodes = 1,
+    }
+  },
+  {
+    .name = "snapshot",
+    .ops = {
+      .make_node = rootdir_snapshot_make_node,
+      .private_nodes = 1,
+      .type = DT_DIR,
+    }
+  },
+  {
+    .name = "slow-requests",
+    .ops = {
+      .make_node = rootdir_trace_make_node,
+    }
+  },
+  {
+    .name = "procfs-memory",
+    .ops = {
+      .make_node = rootdir_memstat_make_node,
+    }
+  },
+  {
+    .name = "procfs-startup",
+    .ops = {
+      .make_node = rootdir_prewarm_make_node,
+    }
   },
 #ifdef PROFILE
   /* In order to get a usable gmon.out file, we must apparently use exit(). */
@@ -654,8 +1158,45 @@ struct node
     .entries = rootdir_entries,
     .entry_ops = {
       .make_node = rootdir_file_make_node,
+      .type = DT_REG,
     },
+    .cache_nodes = 1,
   };
   return procfs_dir_make_node (&ops, pc);
 }
 
+
+error_t
+rootdir_prewarm (struct ps_context *pc)
+{
+  const struct procfs_dir_entry *ent;
+  struct rootdir_static_file *file;
+  struct timeval boottime;
+  host_basic_info_data_t hbi;
+  char *contents;
+  ssize_t contents_len;
+  error_t err, ret = 0;
+
+  for (ent = rootdir_entries; ent->name; ent++)
+    {
+      if (ent->ops.make_node != rootdir_static_make_node)
+	continue;
+
+      file = (struct rootdir_static_file *) ent->hook;
+      pthread_mutex_lock (&file->lock);
+      file->pc = pc;
+      pthread_mutex_unlock (&file->lock);
+
+      err = rootdir_static_get_contents (file, &contents, &contents_len);
+      ret = ret ?: err;
+    }
+
+  err = get_boottime (pc, &boottime);
+  ret = ret ?: err;
+
+  err = get_hostinfo (&hbi);
+  ret = ret ?: err;
+
+  err = rootdir_fetch_cmdline (pc, opt_kernel_pid);
+  return ret ?: err;
+}
@@ -21,3 +21,9 @@
 
 struct node *
 rootdir_make_node (struct ps_context *pc);
+
+/* Fill in advance the caches of the files of the root directory which
+   don't change while we're running: the static files, the boot time, the
+   basic information about the host and the command line of the kernel.  */
+error_t
+rootdir_prewarm (struct ps_context *pc);
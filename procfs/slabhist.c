@@ -0,0 +1,324 @@
+/* Hurd /proc filesystem, history of the kernel slab caches.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <mach.h>
+#include <mach_debug/mach_debug_types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "procfs.h"
+#include "slabhist.h"
+#include "memstat.h"
+#include "main.h"
+
+#include "mach_debug_U.h"
+
+/* A kernel memory leak shows up as a slab cache growing steadily.  To
+   make it easy to spot, a thread samples the number of objects and slabs
+   of each cache every --slab-interval seconds, and the slabgrowth file
+   reports how fast each cache grew over the last few samples, per
+   second.  */
+
+/* The windows over which the growth is reported, in samples.  */
+static const int slabhist_windows[] = { 1, 10, 60 };
+#define SLABHIST_NUM_WINDOWS \
+  (sizeof slabhist_windows / sizeof slabhist_windows[0])
+
+/* The number of samples kept, enough for the largest window.  */
+#define SLABHIST_SIZE 61
+
+struct slabhist_cache
+{
+  char name[CACHE_NAME_MAX_LEN];
+
+  /* The sample numbers from which, and up to which, this cache has been
+     seen.  */
+  unsigned long first, last;
+
+  /* Indexed by sample number modulo SLABHIST_SIZE.  */
+  uint32_t objs[SLABHIST_SIZE];
+  uint32_t slabs[SLABHIST_SIZE];
+};
+
+static pthread_mutex_t slabhist_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct slabhist_cache *slabhist_caches;
+static size_t slabhist_num_caches, slabhist_caches_size;
+
+/* The number of samples taken so far, and when they were taken, in
+   seconds.  */
+static unsigned long slabhist_samples;
+static double slabhist_times[SLABHIST_SIZE];
+
+static struct slabhist_cache *
+slabhist_find (const char *name)
+{
+  struct slabhist_cache *c;
+  size_t i;
+
+  for (i = 0; i < slabhist_num_caches; i++)
+    if (! strncmp (slabhist_caches[i].name, name, CACHE_NAME_MAX_LEN))
+      return &slabhist_caches[i];
+
+  /* The table only ever grows, and doubles when it is full.  */
+  if (slabhist_num_caches == slabhist_caches_size)
+    {
+      size_t size = slabhist_caches_size ? 2 * slabhist_caches_size : 64;
+
+      c = realloc (slabhist_caches, size * sizeof *slabhist_caches);
+      if (! c)
+	return NULL;
+
+      memstat_alloc (MEMSTAT_SLABHIST,
+		     (size - slabhist_caches_size) * sizeof *c);
+      slabhist_caches = c;
+      slabhist_caches_size = size;
+    }
+
+  c = &slabhist_caches[slabhist_num_caches++];
+  memset (c, 0, sizeof *c);
+  strncpy (c->name, name, CACHE_NAME_MAX_LEN);
+  c->first = slabhist_samples;
+  return c;
+}
+
+static void
+slabhist_sample (void)
+{
+  cache_info_array_t cache_info;
+  mach_msg_type_number_t cache_info_count;
+  struct slabhist_cache *c;
+  struct timespec now;
+  int i, slot;
+
+  cache_info = NULL;
+  cache_info_count = 0;
+
+  if (host_slab_info (mach_host_self (), &cache_info, &cache_info_count))
+    return;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock (&slabhist_lock);
+
+  slot = slabhist_samples % SLABHIST_SIZE;
+  slabhist_times[slot] = now.tv_sec + now.tv_nsec / 1e9;
+
+  for (i = 0; i < cache_info_count; i++)
+    {
+      c = slabhist_find (cache_info[i].name);
+      if (! c)
+	continue;
+
+      /* A cache which reappears starts a new history.  */
+      if (c->last + 1 < slabhist_samples)
+	c->first = slabhist_samples;
+
+      c->objs[slot] = cache_info[i].nr_objs;
+      c->slabs[slot] = cache_info[i].nr_slabs;
+      c->last = slabhist_samples;
+    }
+
+  slabhist_samples++;
+  pthread_mutex_unlock (&slabhist_lock);
+
+  vm_deallocate (mach_task_self (),
+		 (vm_address_t) cache_info,
+		 cache_info_count * sizeof *cache_info);
+}
+
+static void *
+slabhist_thread (void *arg)
+{
+  for (;;)
+    {
+      /* The interval can be changed at runtime, or set to 0 to stop
+	 sampling.  */
+      if (opt_slab_interval > 0)
+	slabhist_sample ();
+      sleep (opt_slab_interval > 0 ? opt_slab_interval : 1);
+    }
+
+  return NULL;
+}
+
+error_t
+slabhist_start (void)
+{
+  pthread_t thread;
+  error_t err;
+
+  err = pthread_create (&thread, NULL, slabhist_thread, NULL);
+  if (err)
+    return err;
+
+  pthread_detach (thread);
+  return 0;
+}
+
+
+/* The slabgrowth file */
+
+/* Return the number of samples in the window W which are actually
+   available for the cache C, which must be current.  */
+static int
+slabhist_window (const struct slabhist_cache *c, int w)
+{
+  unsigned long current = slabhist_samples - 1;
+  int n = slabhist_windows[w];
+
+  return current - c->first >= n ? n : 0;
+}
+
+/* Return the growth rate per second of COUNTS, the numbers of objects or
+   slabs of a current cache, over its last N samples.  */
+static double
+slabhist_rate (const uint32_t *counts, int n)
+{
+  unsigned long current = slabhist_samples - 1;
+  int slot = current % SLABHIST_SIZE;
+  int start = (current - n) % SLABHIST_SIZE;
+  double elapsed = slabhist_times[slot] - slabhist_times[start];
+
+  if (elapsed <= 0)
+    return 0;
+
+  return ((long) counts[slot] - (long) counts[start]) / elapsed;
+}
+
+/* Sort by decreasing growth rate of the number of objects over the
+   largest window available.  */
+static int
+slabhist_compare (const void *a, const void *b)
+{
+  const struct slabhist_cache *ca = * (const struct slabhist_cache **) a;
+  const struct slabhist_cache *cb = * (const struct slabhist_cache **) b;
+  double ga = 0, gb = 0;
+  int w, na, nb;
+
+  for (w = SLABHIST_NUM_WINDOWS - 1; w >= 0; w--)
+    {
+      na = slabhist_window (ca, w);
+      nb = slabhist_window (cb, w);
+      if (na || nb)
+	break;
+    }
+
+  if (w >= 0 && na)
+    ga = slabhist_rate (ca->objs, na);
+  if (w >= 0 && nb)
+    gb = slabhist_rate (cb->objs, nb);
+
+  return ga < gb ? 1 : ga > gb ? -1 : strcmp (ca->name, cb->name);
+}
+
+static error_t
+slabhist_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  struct slabhist_cache **sorted;
+  unsigned long current;
+  size_t i, n, len;
+  char label[32];
+  int w, slot, start;
+  FILE *m;
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  pthread_mutex_lock (&slabhist_lock);
+
+  current = slabhist_samples - 1;
+  slot = current % SLABHIST_SIZE;
+
+  /* Only list the caches which were present in the last sample.  */
+  sorted = malloc ((slabhist_num_caches ?: 1) * sizeof *sorted);
+  if (! sorted)
+    {
+      pthread_mutex_unlock (&slabhist_lock);
+      fclose (m);
+      free (*contents);
+      return ENOMEM;
+    }
+
+  for (i = n = 0; slabhist_samples && i < slabhist_num_caches; i++)
+    if (slabhist_caches[i].last == current)
+      sorted[n++] = &slabhist_caches[i];
+  qsort (sorted, n, sizeof *sorted, slabhist_compare);
+
+  /* The header gives the actual length of each window, in seconds, over
+     which the rates per second are averaged.  */
+  fprintf (m, "%-21s %10s %8s", "cache", "objs", "slabs");
+  for (w = 0; w < SLABHIST_NUM_WINDOWS; w++)
+    {
+      if (slabhist_samples > slabhist_windows[w])
+	start = (current - slabhist_windows[w]) % SLABHIST_SIZE;
+      else
+	start = slot;
+
+      snprintf (label, sizeof label, "%.0fs",
+		slabhist_times[slot] - slabhist_times[start]);
+      fprintf (m, " %9s@%-5s %8s@%-5s", "objs/s", label, "slabs/s", label);
+    }
+  fputc ('\n', m);
+
+  for (i = 0; i < n; i++)
+    {
+      struct slabhist_cache *c = sorted[i];
+
+      fprintf (m, "%-21.*s %10lu %8lu", CACHE_NAME_MAX_LEN, c->name,
+	       (unsigned long) c->objs[slot], (unsigned long) c->slabs[slot]);
+
+      for (w = 0; w < SLABHIST_NUM_WINDOWS; w++)
+	{
+	  int nw = slabhist_window (c, w);
+
+	  if (! nw)
+	    {
+	      fprintf (m, " %15s %14s", "-", "-");
+	      continue;
+	    }
+
+	  fprintf (m, " %+15.3f %+14.3f", slabhist_rate (c->objs, nw),
+		   slabhist_rate (c->slabs, nw));
+	}
+      fputc ('\n', m);
+    }
+
+  pthread_mutex_unlock (&slabhist_lock);
+
+  free (sorted);
+  fclose (m);
+  *contents_len = len;
+  return 0;
+}
+
+struct node *
+slabhist_make_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = slabhist_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+
+  return procfs_make_node (&ops, NULL);
+}
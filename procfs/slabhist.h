@@ -0,0 +1,26 @@
+/* Hurd /proc filesystem, history of the kernel slab caches.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Start the thread sampling the slab caches every --slab-interval
+   seconds.  */
+error_t slabhist_start (void);
+
+/* Create a file reporting the growth rate of each slab cache, per second,
+   over several windows of the recorded history.  */
+struct node *slabhist_make_node (void);
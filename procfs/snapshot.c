@@ -0,0 +1,635 @@
+/* Hurd /proc filesystem, consistent snapshots of the whole tree.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <hurd/netfs.h>
+#include "procfs.h"
+#include "snapshot.h"
+#include "memstat.h"
+
+/* Each file of /proc is generated independently when it is read, so that
+   a tool which reads several of them gets information from different
+   moments.  The snapshot directory addresses this: the first time it is
+   listed or searched, the whole /proc tree is generated at once and
+   copied into an immutable image, which is then served as a read-only
+   tree for as long as any of its nodes is in use.
+
+   Each lookup of the snapshot directory gets a recent image, which is not
+   necessarily the same as that of the previous lookup, so clients should
+   open it once and access the files relative to it, for instance with
+   openat(), rather than through full paths.  An image is freed as soon as
+   none of its nodes is in use, and no new one is taken while too many of
+   them are in use.  */
+
+/* The maximum depth of the copied tree, below the snapshot directory.
+   This is enough for the [pid] directories and the indexes.  */
+#define SNAPSHOT_MAX_DEPTH 3
+
+struct snapshot_entry
+{
+  char *name;
+
+  /* The type and permission bits, and the owner of the original node.  */
+  mode_t mode;
+  uid_t owner;
+
+  /* The contents of the original node.  For directories, this is the
+     list of the entries which have been copied.  */
+  char *contents;
+  ssize_t contents_len;
+
+  struct snapshot_entry *entries;
+  size_t num_entries, max_entries;
+};
+
+struct snapshot_image
+{
+  int references;
+  struct snapshot_entry root;
+
+  /* When the copy was started, which dates all of its files.  */
+  struct timespec time;
+};
+
+/* Images are shared by the snapshot directories used within this many
+   seconds of each other.  */
+#define SNAPSHOT_WINDOW 1
+
+/* No new image is taken while this many of them are in use.  */
+#define SNAPSHOT_MAX_IMAGES 4
+
+/* The entries of /proc are copied by this many threads at once, since
+   most of the time is spent waiting for the other servers to reply.  */
+#define SNAPSHOT_THREADS 4
+
+/* This protects the reference counts and the variables below.  */
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The latest image, when it was taken, and how many images exist.  The
+   latest image is not referenced by SNAPSHOT_LATEST, which is reset when
+   it is freed.  */
+static struct snapshot_image *snapshot_latest;
+static time_t snapshot_latest_time;
+static int snapshot_num_images;
+
+/* This is held while an image is being taken.  */
+static pthread_mutex_t snapshot_take_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The entries of the live tree which are not copied.  The snapshot
+   directory itself would recurse, and looking up "exit" in profiling
+   builds terminates the server.  */
+static const char *const snapshot_excluded[] = {
+  ".", "..", "snapshot", "exit", NULL
+};
+
+
+/* Building images */
+
+static void
+snapshot_entry_free (struct snapshot_entry *e)
+{
+  size_t i;
+
+  for (i = 0; i < e->num_entries; i++)
+    snapshot_entry_free (&e->entries[i]);
+
+  free (e->entries);
+  free (e->contents);
+  free (e->name);
+}
+
+/* Account for the memory used by E and its children, as allocated if
+   ALLOC is nonzero, or as released otherwise.  */
+static void
+snapshot_entry_account (struct snapshot_entry *e, int alloc)
+{
+  void (*account) (enum memstat_category, size_t);
+  size_t i;
+
+  account = alloc ? memstat_alloc : memstat_free;
+
+  for (i = 0; i < e->num_entries; i++)
+    snapshot_entry_account (&e->entries[i], alloc);
+
+  if (e->entries)
+    account (MEMSTAT_SNAPSHOTS, e->max_entries * sizeof *e->entries);
+  if (e->contents)
+    account (MEMSTAT_SNAPSHOTS, e->contents_len);
+  if (e->name)
+    account (MEMSTAT_SNAPSHOTS, strlen (e->name) + 1);
+}
+
+static int
+snapshot_excluded_name (const char *name)
+{
+  const char *const *p;
+
+  for (p = snapshot_excluded; *p; p++)
+    if (! strcmp (*p, name))
+      return 1;
+
+  return 0;
+}
+
+static error_t snapshot_copy_dir (struct node *dir, struct snapshot_entry *e,
+				  int depth);
+
+/* Copy the node NP into E, which already has its name.  Return ENOENT if
+   the node should be left out of the image.  The live nodes may be in use
+   by other clients, so their cached contents are left alone, and they
+   are only locked while they are being copied.  */
+static error_t
+snapshot_copy_node (struct node *np, struct snapshot_entry *e, int depth)
+{
+  char *contents;
+  ssize_t contents_len;
+  error_t err;
+
+  pthread_mutex_lock (&np->lock);
+
+  /* Translated nodes can't be copied, and writable ones are the private
+     files which depend on what their client wrote to them.  */
+  if ((np->nn_translated & S_IPTRANS) || procfs_writable (np))
+    {
+      pthread_mutex_unlock (&np->lock);
+      return ENOENT;
+    }
+
+  e->mode = np->nn_stat.st_mode & (S_IFMT | ALLPERMS);
+  e->owner = np->nn_stat.st_uid;
+
+  if (S_ISDIR (e->mode))
+    {
+      pthread_mutex_unlock (&np->lock);
+      return depth < SNAPSHOT_MAX_DEPTH ? snapshot_copy_dir (np, e, depth + 1)
+					: ENOENT;
+    }
+
+  err = procfs_generate_contents (np, &contents, &contents_len);
+  if (! err)
+    {
+      e->contents = malloc (contents_len ?: 1);
+      if (e->contents)
+	{
+	  memcpy (e->contents, contents, contents_len);
+	  e->contents_len = contents_len;
+	}
+      else
+	err = ENOMEM;
+
+      procfs_release_contents (np, contents, contents_len);
+    }
+
+  pthread_mutex_unlock (&np->lock);
+  return err;
+}
+
+/* The copy of the entries of a directory, which can be shared by
+   several threads.  */
+struct snapshot_copy
+{
+  struct node *dir;
+  struct snapshot_entry *e;
+  int depth;
+  char *names;
+  ssize_t names_len;
+
+  /* This protects the members below.  */
+  pthread_mutex_t lock;
+
+  /* The next entry to copy, and its index in the list of names.  */
+  char *next;
+  size_t next_index;
+
+  error_t err;
+};
+
+/* Copy the entries of C which have not been taken yet, one at a time,
+   into the entry with the same index as their name.  The processes and
+   files which vanish in the meantime are simply left out.  */
+static void *
+snapshot_copy_entries (void *arg)
+{
+  struct snapshot_copy *c = arg;
+  struct snapshot_entry *child;
+  struct node *np;
+  char *name;
+  error_t err;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&c->lock);
+      if (c->err || c->next >= c->names + c->names_len)
+	{
+	  pthread_mutex_unlock (&c->lock);
+	  return NULL;
+	}
+      name = c->next;
+      child = &c->e->entries[c->next_index];
+      c->next += strlen (name) + 1;
+      c->next_index++;
+      pthread_mutex_unlock (&c->lock);
+
+      if (snapshot_excluded_name (name))
+	continue;
+
+      pthread_mutex_lock (&c->dir->lock);
+      err = procfs_lookup (c->dir, name, &np);
+      pthread_mutex_unlock (&c->dir->lock);
+      if (err)
+	continue;
+
+      child->name = strdup (name);
+      err = child->name ? snapshot_copy_node (np, child, c->depth) : ENOMEM;
+      netfs_nrele (np);
+
+      if (err)
+	{
+	  snapshot_entry_free (child);
+	  memset (child, 0, sizeof *child);
+	}
+
+      if (err == ENOMEM)
+	{
+	  pthread_mutex_lock (&c->lock);
+	  c->err = err;
+	  pthread_mutex_unlock (&c->lock);
+	}
+    }
+}
+
+/* Copy the entries of the directory DIR into E.  Those of /proc itself
+   are copied by SNAPSHOT_THREADS threads.  */
+static error_t
+snapshot_copy_dir (struct node *dir, struct snapshot_entry *e, int depth)
+{
+  static const char dot_dotdot[] = ".\0..";
+  pthread_t threads[SNAPSHOT_THREADS - 1];
+  struct snapshot_copy c;
+  char *contents, *names, *name;
+  ssize_t contents_len;
+  size_t len, n, i;
+  int num_threads = 0;
+  FILE *m;
+  error_t err;
+
+  /* Work on a copy of the list of the entries, so that DIR is not kept
+     locked while they are copied.  */
+  pthread_mutex_lock (&dir->lock);
+  err = procfs_generate_contents (dir, &contents, &contents_len);
+  if (! err)
+    {
+      names = malloc (contents_len ?: 1);
+      if (names)
+	memcpy (names, contents, contents_len);
+      else
+	err = ENOMEM;
+
+      procfs_release_contents (dir, contents, contents_len);
+    }
+  pthread_mutex_unlock (&dir->lock);
+  if (err)
+    return err;
+
+  for (name = names, n = 0; name < names + contents_len;
+       name += strlen (name) + 1)
+    n++;
+
+  e->entries = calloc (n ?: 1, sizeof *e->entries);
+  e->max_entries = n ?: 1;
+  if (! e->entries)
+    {
+      free (names);
+      return ENOMEM;
+    }
+
+  c.dir = dir;
+  c.e = e;
+  c.depth = depth;
+  c.names = c.next = names;
+  c.names_len = contents_len;
+  c.next_index = 0;
+  c.err = 0;
+  pthread_mutex_init (&c.lock, NULL);
+
+  if (depth == 1)
+    while (num_threads < SNAPSHOT_THREADS - 1
+	   && ! pthread_create (&threads[num_threads], NULL,
+				snapshot_copy_entries, &c))
+      num_threads++;
+
+  snapshot_copy_entries (&c);
+  while (num_threads)
+    pthread_join (threads[--num_threads], NULL);
+
+  pthread_mutex_destroy (&c.lock);
+  free (names);
+
+  /* Keep the entries which have been copied, in order.  */
+  for (i = 0; i < n; i++)
+    if (e->entries[i].name)
+      e->entries[e->num_entries++] = e->entries[i];
+
+  if (c.err)
+    return c.err;
+
+  m = open_memstream (&e->contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  fwrite (dot_dotdot, 1, sizeof dot_dotdot, m);
+  for (i = 0; i < e->num_entries; i++)
+    fwrite (e->entries[i].name, 1, strlen (e->entries[i].name) + 1, m);
+
+  fclose (m);
+  e->contents_len = len;
+  return 0;
+}
+
+/* Copy the whole /proc tree into a new image.  */
+static struct snapshot_image *
+snapshot_take (void)
+{
+  struct snapshot_image *image;
+  error_t err;
+
+  image = calloc (1, sizeof *image);
+  if (! image)
+    return NULL;
+
+  image->references = 1;
+  image->root.mode = S_IFDIR | 0555;
+  clock_gettime (CLOCK_REALTIME, &image->time);
+
+  err = snapshot_copy_dir (netfs_root_node, &image->root, 1);
+  if (err)
+    {
+      snapshot_entry_free (&image->root);
+      free (image);
+      return NULL;
+    }
+
+  snapshot_entry_account (&image->root, 1);
+  memstat_alloc (MEMSTAT_SNAPSHOTS, sizeof *image);
+
+  pthread_mutex_lock (&snapshot_lock);
+  snapshot_num_images++;
+  pthread_mutex_unlock (&snapshot_lock);
+
+  return image;
+}
+
+static void
+snapshot_release (struct snapshot_image *image)
+{
+  int last;
+
+  pthread_mutex_lock (&snapshot_lock);
+  last = --image->references == 0;
+  if (last)
+    {
+      snapshot_num_images--;
+      if (snapshot_latest == image)
+	snapshot_latest = NULL;
+    }
+  pthread_mutex_unlock (&snapshot_lock);
+
+  if (last)
+    {
+      snapshot_entry_account (&image->root, 0);
+      memstat_free (MEMSTAT_SNAPSHOTS, sizeof *image);
+      snapshot_entry_free (&image->root);
+      free (image);
+    }
+}
+
+/* Get a new reference to a recent image in *IMAGE.  Only one image is
+   taken at a time, and it is shared by the snapshot directories which are
+   used within SNAPSHOT_WINDOW seconds.  Fail with EBUSY rather than take
+   a new image while there are SNAPSHOT_MAX_IMAGES of them, so that the
+   clients can't make us use an arbitrary amount of memory.  */
+static error_t
+snapshot_get (struct snapshot_image **image)
+{
+  struct timespec now;
+  error_t err = 0;
+
+  pthread_mutex_lock (&snapshot_take_lock);
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock (&snapshot_lock);
+  *image = snapshot_latest;
+  if (*image && now.tv_sec - snapshot_latest_time < SNAPSHOT_WINDOW)
+    (*image)->references++;
+  else
+    {
+      *image = NULL;
+      if (snapshot_num_images >= SNAPSHOT_MAX_IMAGES)
+	err = EBUSY;
+    }
+  pthread_mutex_unlock (&snapshot_lock);
+
+  if (! *image && ! err)
+    {
+      *image = snapshot_take ();
+      if (*image)
+	{
+	  pthread_mutex_lock (&snapshot_lock);
+	  snapshot_latest = *image;
+	  snapshot_latest_time = now.tv_sec;
+	  pthread_mutex_unlock (&snapshot_lock);
+	}
+      else
+	err = ENOMEM;
+    }
+
+  pthread_mutex_unlock (&snapshot_take_lock);
+  return err;
+}
+
+
+/* Serving images */
+
+/* The hook of the nodes of an image.  For the snapshot directory itself,
+   the image is only taken when it is first needed, so that stat'ing it,
+   as when listing /proc, is cheap.  */
+struct snapshot_node
+{
+  struct snapshot_image *image;
+  struct snapshot_entry *entry;
+};
+
+static error_t
+snapshot_node_get_contents (void *hook, char **contents,
+			    ssize_t *contents_len)
+{
+  struct snapshot_node *sn = hook;
+
+  *contents = sn->entry->contents;
+  *contents_len = sn->entry->contents_len;
+  return 0;
+}
+
+static void
+snapshot_node_get_mtime (void *hook, struct timespec *mtime)
+{
+  struct snapshot_node *sn = hook;
+
+  *mtime = sn->image->time;
+}
+
+static struct snapshot_entry *
+snapshot_find (struct snapshot_entry *dir, const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < dir->num_entries; i++)
+    if (! strcmp (dir->entries[i].name, name))
+      return &dir->entries[i];
+
+  return NULL;
+}
+
+static unsigned char
+snapshot_node_get_dirent_type (void *hook, const char *name)
+{
+  struct snapshot_node *sn = hook;
+  struct snapshot_entry *e = snapshot_find (sn->entry, name);
+
+  return e ? IFTODT (e->mode) : DT_UNKNOWN;
+}
+
+static void
+snapshot_node_cleanup (void *hook)
+{
+  struct snapshot_node *sn = hook;
+
+  if (sn->image)
+    snapshot_release (sn->image);
+
+  memstat_free (MEMSTAT_DIRS, sizeof *sn);
+  free (sn);
+}
+
+static error_t
+snapshot_node_lookup (void *hook, const char *name, struct node **np)
+{
+  static const struct procfs_node_ops dir_ops = {
+    .get_contents = snapshot_node_get_contents,
+    .lookup = snapshot_node_lookup,
+    .cleanup = snapshot_node_cleanup,
+    .get_dirent_type = snapshot_node_get_dirent_type,
+  };
+  static const struct procfs_node_ops file_ops = {
+    .get_contents = snapshot_node_get_contents,
+    .cleanup = snapshot_node_cleanup,
+    .get_mtime = snapshot_node_get_mtime,
+  };
+  struct snapshot_node *sn = hook, *child;
+  struct snapshot_entry *e;
+
+  e = snapshot_find (sn->entry, name);
+  if (! e)
+    return ENOENT;
+
+  child = malloc (sizeof *child);
+  if (! child)
+    return ENOMEM;
+
+  pthread_mutex_lock (&snapshot_lock);
+  sn->image->references++;
+  pthread_mutex_unlock (&snapshot_lock);
+
+  child->image = sn->image;
+  child->entry = e;
+  memstat_alloc (MEMSTAT_DIRS, sizeof *child);
+
+  *np = procfs_make_node (S_ISDIR (e->mode) ? &dir_ops : &file_ops, child);
+  if (! *np)
+    return ENOMEM;
+
+  procfs_node_chtype (*np, e->mode & S_IFMT);
+  procfs_node_chmod (*np, e->mode & ALLPERMS);
+  procfs_node_chown (*np, e->owner);
+  return 0;
+}
+
+/* Take the image of the snapshot directory SN if needed.  */
+static error_t
+snapshot_dir_take (struct snapshot_node *sn)
+{
+  error_t err;
+
+  if (sn->image)
+    return 0;
+
+  err = snapshot_get (&sn->image);
+  if (err)
+    return err;
+
+  sn->entry = &sn->image->root;
+  return 0;
+}
+
+static error_t
+snapshot_dir_get_contents (void *hook, char **contents,
+			   ssize_t *contents_len)
+{
+  error_t err = snapshot_dir_take (hook);
+  return err ?: snapshot_node_get_contents (hook, contents, contents_len);
+}
+
+static error_t
+snapshot_dir_lookup (void *hook, const char *name, struct node **np)
+{
+  error_t err = snapshot_dir_take (hook);
+  return err ?: snapshot_node_lookup (hook, name, np);
+}
+
+static unsigned char
+snapshot_dir_get_dirent_type (void *hook, const char *name)
+{
+  struct snapshot_node *sn = hook;
+  return sn->image ? snapshot_node_get_dirent_type (hook, name) : DT_UNKNOWN;
+}
+
+struct node *
+snapshot_make_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = snapshot_dir_get_contents,
+    .lookup = snapshot_dir_lookup,
+    .cleanup = snapshot_node_cleanup,
+    .get_dirent_type = snapshot_dir_get_dirent_type,
+  };
+  struct snapshot_node *sn;
+
+  sn = calloc (1, sizeof *sn);
+  if (! sn)
+    return NULL;
+
+  memstat_alloc (MEMSTAT_DIRS, sizeof *sn);
+
+  return procfs_make_node (&ops, sn);
+}
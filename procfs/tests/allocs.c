@@ -0,0 +1,226 @@
+/* Hurd /proc filesystem, test of the number of allocations per request.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <error.h>
+#include "sim.h"
+
+/* This test interposes malloc() and counts the allocations made by procfs
+   while it serves some common requests, not including those of the
+   simulated system.  It fails if one of them makes more allocations than
+   it used to, so that a regression does not go unnoticed, and checks that
+   the allocation counts of the procfs-memory file do not exceed the real
+   ones.  When the number of allocations of a request goes down, lower its
+   bound below.  */
+
+/* The buffers listing the processes grow as needed, so the bound of the
+   listing of /proc depends on their number.  */
+#define ALLOCS_NUM_PROCS 1000
+
+
+/* Interposition of the allocator */
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static int allocs_counting;
+static unsigned long allocs_count;
+
+static void
+allocs_note (void)
+{
+  if (allocs_counting && ! sim_internal)
+    allocs_count++;
+}
+
+void *
+malloc (size_t size)
+{
+  allocs_note ();
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  allocs_note ();
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  allocs_note ();
+  return __libc_realloc (ptr, size);
+}
+
+
+/* The requests */
+
+static struct sim_file *
+allocs_open (const char *path)
+{
+  struct sim_file *file;
+  error_t err;
+
+  err = sim_open (path, &file);
+  if (err)
+    error (1, err, "%s", path);
+
+  return file;
+}
+
+static void
+allocs_read (struct sim_file *file)
+{
+  size_t len;
+  error_t err;
+
+  err = sim_read_all (file, &len);
+  if (err)
+    error (1, err, "read");
+}
+
+static void
+allocs_ignore_name (const char *name, void *arg)
+{
+}
+
+static void
+allocs_list (struct sim_file *file)
+{
+  int amt;
+  error_t err;
+
+  do
+    {
+      err = sim_readdir (file, -1, &amt, allocs_ignore_name, NULL);
+      if (err)
+	error (1, err, "readdir");
+    }
+  while (amt);
+}
+
+/* The files are opened before counting when only reading them is
+   measured.  */
+struct allocs_request
+{
+  const char *name;
+  const char *path;
+  void (*op) (struct sim_file *file);
+  unsigned long bound;
+};
+
+static const struct allocs_request requests[] = {
+  { "read [pid]/stat", "42/stat", allocs_read, 6 },
+  { "read meminfo", "meminfo", allocs_read, 5 },
+  { "list /proc", "", allocs_list, 12 },
+  { "lookup [pid]", "43", NULL, 12 },
+};
+
+
+/* The procfs-memory file, kept open so that reading it again does not
+   make new nodes.  */
+static struct sim_file *allocs_memstat_file;
+
+/* Return the total number of allocations listed in procfs-memory.  */
+static unsigned long
+allocs_memstat_total (void)
+{
+  static char buf[4096];
+  unsigned long total = 0, allocs;
+  char *line, *next;
+  size_t len;
+  error_t err;
+
+  sim_rewind (allocs_memstat_file);
+  len = sizeof buf - 1;
+  err = sim_read (allocs_memstat_file, buf, &len);
+  if (err)
+    error (1, err, "procfs-memory");
+  buf[len] = '\0';
+
+  /* Skip the header.  */
+  line = strchr (buf, '\n');
+  for (; line && *++line; line = next)
+    {
+      next = strchr (line, '\n');
+      if (sscanf (line, "%*s %*d %*d %lu", &allocs) == 1)
+	total += allocs;
+    }
+
+  return total;
+}
+
+int
+main (int argc, char **argv)
+{
+  const struct allocs_request *r;
+  unsigned long before, memstat_before, memstat;
+  int failed = 0;
+
+  sim_init (ALLOCS_NUM_PROCS);
+  allocs_memstat_file = allocs_open ("procfs-memory");
+  allocs_memstat_total ();
+
+  printf ("%-20s %8s %8s %8s\n", "request", "allocs", "bound", "memstat");
+  for (r = requests; r < requests + sizeof requests / sizeof requests[0]; r++)
+    {
+      struct sim_file *file = NULL;
+
+      if (r->op)
+	file = allocs_open (r->path);
+
+      memstat_before = allocs_memstat_total ();
+      before = allocs_count;
+      allocs_counting = 1;
+      if (r->op)
+	r->op (file);
+      else
+	file = allocs_open (r->path);
+      allocs_counting = 0;
+
+      /* Reading procfs-memory makes two allocations for its own contents
+	 once they are generated, which only show up the next time.  */
+      memstat = allocs_memstat_total () - memstat_before - 2;
+
+      printf ("%-20s %8lu %8lu %8lu\n", r->name, allocs_count - before,
+	      r->bound, memstat);
+      if (allocs_count - before > r->bound)
+	{
+	  fprintf (stderr, "%s: %lu allocations, expected at most %lu\n",
+		   r->name, allocs_count - before, r->bound);
+	  failed = 1;
+	}
+      if (memstat > allocs_count - before)
+	{
+	  fprintf (stderr, "%s: procfs-memory counts %lu allocations, "
+		   "more than the %lu made\n",
+		   r->name, memstat, allocs_count - before);
+	  failed = 1;
+	}
+
+      sim_close (file);
+    }
+
+  return failed;
+}
@@ -0,0 +1,34 @@
+/* Simulated <dirent.h>, see sim-hurd.h.  The directory entries which
+   netfs_get_dirents() fills have the layout of the Hurd.  */
+
+#ifndef __SIM_DIRENT_H__
+#define __SIM_DIRENT_H__
+
+#include "sim-hurd.h"
+
+struct dirent
+{
+  ino_t d_fileno;
+  unsigned short int d_reclen;
+  unsigned char d_type;
+  unsigned char d_namlen;
+  char d_name[1];
+};
+
+enum
+{
+  DT_UNKNOWN = 0,
+  DT_FIFO = 1,
+  DT_CHR = 2,
+  DT_DIR = 4,
+  DT_BLK = 6,
+  DT_REG = 8,
+  DT_LNK = 10,
+  DT_SOCK = 12,
+  DT_WHT = 14
+};
+
+#define IFTODT(mode)	(((mode) & 0170000) >> 12)
+#define DTTOIF(type)	((type) << 12)
+
+#endif /* __SIM_DIRENT_H__ */
@@ -0,0 +1,2 @@
+/* Simulated <hurd.h>, see sim-hurd.h.  */
+#include "sim-hurd.h"
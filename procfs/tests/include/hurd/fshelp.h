@@ -0,0 +1,2 @@
+/* Simulated <hurd/fshelp.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
@@ -0,0 +1,2 @@
+/* Simulated <hurd/hurd_types.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
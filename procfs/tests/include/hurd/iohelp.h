@@ -0,0 +1,2 @@
+/* Simulated <hurd/iohelp.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
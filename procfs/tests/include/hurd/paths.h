@@ -0,0 +1,2 @@
+/* Simulated <hurd/paths.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
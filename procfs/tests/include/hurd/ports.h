@@ -0,0 +1,2 @@
+/* Simulated <hurd/ports.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
@@ -0,0 +1,2 @@
+/* Simulated <mach/default_pager.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
@@ -0,0 +1,2 @@
+/* Simulated <mach/gnumach.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
@@ -0,0 +1,2 @@
+/* Simulated <mach/vm_statistics.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
@@ -0,0 +1,2 @@
+/* Simulated <mach_debug/mach_debug_types.h>, see sim-hurd.h.  */
+#include "../sim-hurd.h"
@@ -0,0 +1,2 @@
+/* Simulated <mach_debug_U.h>, see sim-hurd.h.  */
+#include "sim-hurd.h"
@@ -0,0 +1,2 @@
+/* Simulated <ps.h>, see sim-hurd.h.  */
+#include "sim-hurd.h"
@@ -0,0 +1,465 @@
+/* Hurd /proc filesystem, simulated Mach and Hurd interfaces for the tests.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* The tests build the procfs sources on the host system, against this
+   header instead of those of GNU Mach, the Hurd libraries and libps.
+   The other headers of this directory only include it under the names
+   used by the sources.  It declares just what procfs uses, with the same
+   names and the same semantics, and the definitions are in sim.c.  */
+
+#ifndef __SIM_HURD_H__
+#define __SIM_HURD_H__
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <argp.h>
+#include <time.h>
+
+#ifndef __error_t_defined
+typedef int error_t;
+# define __error_t_defined 1
+#endif
+
+/* The Hurd specific error codes.  */
+#define EIEIO		1104
+#define EGRATUITOUS	1105
+
+
+/* GNU Mach */
+
+typedef unsigned int mach_port_t;
+typedef unsigned int mach_msg_type_number_t;
+typedef uintptr_t vm_address_t;
+typedef unsigned int vm_size_t;
+typedef int boolean_t;
+typedef int kern_return_t;
+typedef int integer_t;
+typedef mach_port_t task_t;
+typedef mach_port_t thread_t;
+typedef mach_port_t process_t;
+typedef mach_port_t *portarray_t;
+typedef int *pidarray_t;
+
+#define MACH_PORT_NULL		((mach_port_t) 0)
+#define MACH_PORT_DEAD		((mach_port_t) ~0)
+#define MACH_PORT_VALID(name)	((name) != MACH_PORT_NULL \
+				 && (name) != MACH_PORT_DEAD)
+
+mach_port_t mach_task_self (void);
+mach_port_t mach_host_self (void);
+thread_t mach_thread_self (void);
+kern_return_t mach_port_deallocate (mach_port_t task, mach_port_t name);
+kern_return_t task_get_bootstrap_port (mach_port_t task, mach_port_t *port);
+kern_return_t vm_allocate (mach_port_t task, vm_address_t *addr,
+			   vm_size_t size, boolean_t anywhere);
+kern_return_t vm_deallocate (mach_port_t task, vm_address_t addr,
+			     vm_size_t size);
+
+typedef struct time_value
+{
+  integer_t seconds;
+  integer_t microseconds;
+} time_value_t;
+
+struct task_basic_info
+{
+  integer_t suspend_count;
+  integer_t base_priority;
+  vm_size_t virtual_size;
+  vm_size_t resident_size;
+  time_value_t user_time;
+  time_value_t system_time;
+  time_value_t creation_time;
+};
+typedef struct task_basic_info *task_basic_info_t;
+
+struct thread_basic_info
+{
+  time_value_t user_time;
+  time_value_t system_time;
+  integer_t cpu_usage;
+  integer_t base_priority;
+  integer_t cur_priority;
+  integer_t run_state;
+  integer_t flags;
+  integer_t suspend_count;
+  integer_t sleep_time;
+  time_value_t creation_time;
+};
+typedef struct thread_basic_info *thread_basic_info_t;
+
+#define TH_FLAGS_IDLE		0x4
+#define MACH_PRIORITY_TO_NICE(pri)	(2 * ((pri) - 12))
+
+typedef integer_t *host_info_t;
+
+#define HOST_BASIC_INFO		1
+#define HOST_LOAD_INFO		4
+
+typedef struct host_basic_info
+{
+  integer_t max_cpus;
+  integer_t avail_cpus;
+  vm_size_t memory_size;
+  integer_t cpu_type;
+  integer_t cpu_subtype;
+} host_basic_info_data_t, *host_basic_info_t;
+#define HOST_BASIC_INFO_COUNT \
+  (sizeof (host_basic_info_data_t) / sizeof (integer_t))
+
+#define LOAD_SCALE		1000
+typedef struct host_load_info
+{
+  integer_t avenrun[3];
+  integer_t mach_factor[3];
+} host_load_info_data_t;
+#define HOST_LOAD_INFO_COUNT \
+  (sizeof (host_load_info_data_t) / sizeof (integer_t))
+
+kern_return_t host_info (mach_port_t host, int flavor, host_info_t info,
+			 mach_msg_type_number_t *count);
+
+/* <mach/vm_param.h> */
+#ifndef PAGE_SIZE
+# define PAGE_SIZE		4096
+#endif
+
+/* <mach/vm_statistics.h> */
+struct vm_statistics
+{
+  integer_t pagesize;
+  integer_t free_count;
+  integer_t active_count;
+  integer_t inactive_count;
+  integer_t wire_count;
+  integer_t zero_fill_count;
+  integer_t reactivations;
+  integer_t pageins;
+  integer_t pageouts;
+  integer_t faults;
+  integer_t cow_faults;
+  integer_t lookups;
+  integer_t hits;
+};
+kern_return_t vm_statistics (mach_port_t task, struct vm_statistics *stats);
+
+/* <mach/vm_cache_statistics.h> */
+struct vm_cache_statistics
+{
+  integer_t cache_object_count;
+  integer_t cache_count;
+  integer_t active_tmp_count;
+  integer_t inactive_tmp_count;
+  integer_t active_perm_count;
+  integer_t inactive_perm_count;
+  integer_t dirty_count;
+  integer_t laundry_count;
+  integer_t writeback_count;
+  integer_t slab_count;
+  integer_t slab_reclaim_count;
+};
+kern_return_t vm_cache_statistics (mach_port_t task,
+				   struct vm_cache_statistics *stats);
+
+/* <mach/default_pager.h> */
+typedef struct default_pager_info
+{
+  vm_size_t dpi_total_space;
+  vm_size_t dpi_free_space;
+  vm_size_t dpi_page_size;
+} default_pager_info_t;
+kern_return_t default_pager_info (mach_port_t pager,
+				  default_pager_info_t *info);
+
+/* <mach_debug/mach_debug_types.h> and mach_debug_U.h */
+#define CACHE_NAME_MAX_LEN	32
+#define CACHE_FLAGS_NO_CPU_POOL		0x01
+#define CACHE_FLAGS_SLAB_EXTERNAL	0x02
+#define CACHE_FLAGS_NO_RECLAIM		0x04
+
+typedef struct cache_info
+{
+  int flags;
+  size_t cpu_pool_size;
+  size_t obj_size;
+  size_t align;
+  size_t buf_size;
+  size_t slab_size;
+  unsigned long bufs_per_slab;
+  unsigned long nr_objs;
+  unsigned long nr_bufs;
+  unsigned long nr_slabs;
+  unsigned long nr_free_slabs;
+  char name[CACHE_NAME_MAX_LEN];
+} cache_info_t;
+typedef cache_info_t *cache_info_array_t;
+
+kern_return_t host_slab_info (mach_port_t host, cache_info_array_t *info,
+			      mach_msg_type_number_t *count);
+
+
+/* The Hurd interfaces */
+
+typedef mach_port_t file_t;
+typedef mach_port_t fsys_t;
+typedef char string_t[1024];
+typedef char *data_t;
+
+/* The flags of file_name_lookup() and of the permission checks.  */
+#define O_READ			0x0001
+#define O_WRITE			0x0002
+#define O_EXEC			0x0004
+
+#define S_IPTRANS		000010000000
+
+#define _SERVERS_DEFPAGER	"/servers/default-pager"
+
+process_t getproc (void);
+error_t hurd_thread_cancel (thread_t thread);
+int hurd_check_cancel (void);
+file_t getcrdir (void);
+file_t file_name_lookup (const char *name, int flags, mode_t mode);
+error_t file_getcontrol (file_t file, fsys_t *control);
+error_t fsys_get_options (fsys_t control, data_t *options,
+			  mach_msg_type_number_t *options_len);
+error_t fsys_get_source (fsys_t control, string_t source);
+error_t fsys_get_children (fsys_t control, data_t *names,
+			   mach_msg_type_number_t *names_len,
+			   portarray_t *controls,
+			   mach_msg_type_number_t *controls_len);
+
+/* <hurd/process.h> */
+error_t proc_getallpids (process_t proc, pidarray_t *pids,
+			 mach_msg_type_number_t *num_pids);
+error_t proc_pid2proc (process_t proc, pid_t pid, process_t *p);
+error_t proc_is_important (process_t p, boolean_t *essential);
+error_t proc_get_code (process_t p, vm_address_t *start, vm_address_t *end);
+
+
+/* libports */
+
+typedef struct mach_msg_header
+{
+  mach_port_t msgh_local_port;
+  integer_t msgh_id;
+} mach_msg_header_t;
+
+typedef void (*mig_routine_t) (mach_msg_header_t *, mach_msg_header_t *);
+typedef int (*ports_demuxer_type) (mach_msg_header_t *, mach_msg_header_t *);
+
+struct port_bucket;
+struct port_class;
+
+void *ports_lookup_port (struct port_bucket *bucket, mach_port_t port,
+			 struct port_class *class);
+void ports_port_deref (void *port);
+mig_routine_t ports_notify_server_routine (mach_msg_header_t *inp);
+mig_routine_t ports_interrupt_server_routine (mach_msg_header_t *inp);
+void ports_manage_port_operations_multithread (struct port_bucket *bucket,
+					       ports_demuxer_type demuxer,
+					       int thread_timeout,
+					       int global_timeout,
+					       void (*hook) (void));
+
+
+/* libiohelp and libfshelp */
+
+struct idvec
+{
+  uid_t *ids;
+  unsigned num, alloced;
+};
+
+struct iouser
+{
+  struct idvec *uids, *gids;
+  void *hook;
+};
+
+error_t iohelp_dup_iouser (struct iouser **clone, struct iouser *iouser);
+void iohelp_free_iouser (struct iouser *iouser);
+error_t fshelp_access (struct stat *st, int op, struct iouser *user);
+
+
+/* libnetfs */
+
+#define ino64_t __ino64_t
+
+struct node
+{
+  struct netnode *nn;
+  struct stat nn_stat;
+  int nn_translated;
+  pthread_mutex_t lock;
+  int references;
+};
+
+/* The statistics of the filesystem, as returned by fsys_statfs.  */
+typedef struct fsys_statfsbuf
+{
+  int f_type;
+  unsigned long f_bsize;
+  unsigned long f_blocks;
+  unsigned long f_files;
+  unsigned long f_fsid;
+  unsigned long f_namelen;
+} fsys_statfsbuf_t;
+
+#define FSTYPE_PROC		0x0000001a
+
+extern pthread_spinlock_t netfs_node_refcnt_lock;
+extern struct node *netfs_root_node;
+extern struct port_bucket *netfs_port_bucket;
+extern struct port_class *netfs_control_class;
+extern struct argp netfs_std_startup_argp, netfs_std_runtime_argp;
+
+struct node *netfs_make_node (struct netnode *nn);
+void netfs_nref (struct node *np);
+void netfs_nrele (struct node *np);
+void netfs_nput (struct node *np);
+void netfs_init (void);
+mach_port_t netfs_startup (mach_port_t bootstrap, int flags);
+void netfs_server_loop (void);
+int netfs_demuxer (mach_msg_header_t *inp, mach_msg_header_t *outp);
+error_t netfs_shutdown (int flags);
+error_t netfs_append_std_options (char **argz, size_t *argz_len);
+error_t netfs_append_args (char **argz, size_t *argz_len);
+
+/* The callbacks of libnetfs, which procfs defines in netfs.c.  */
+error_t netfs_validate_stat (struct node *np, struct iouser *cred);
+error_t netfs_attempt_read (struct iouser *cred, struct node *np,
+			    loff_t offset, size_t *len, void *data);
+error_t netfs_get_dirents (struct iouser *cred, struct node *dir,
+			   int entry, int nentries, char **data,
+			   mach_msg_type_number_t *datacnt,
+			   vm_size_t bufsize, int *amt);
+error_t netfs_attempt_lookup (struct iouser *user, struct node *dir,
+			      char *name, struct node **np);
+error_t netfs_check_open_permissions (struct iouser *user, struct node *np,
+				      int flags, int newnode);
+void netfs_node_norefs (struct node *np);
+
+
+/* libps */
+
+typedef unsigned int ps_flags_t;
+
+#define PSTAT_PID		0x00001
+#define PSTAT_THREAD		0x00002
+#define PSTAT_PROCESS		0x00004
+#define PSTAT_TASK		0x00008
+#define PSTAT_MSGPORT		0x00010
+#define PSTAT_PROC_INFO		0x00020
+#define PSTAT_TASK_BASIC	0x00040
+#define PSTAT_TASK_EVENTS	0x00080
+#define PSTAT_NUM_THREADS	0x00100
+#define PSTAT_THREAD_BASIC	0x00200
+#define PSTAT_THREAD_SCHED	0x00400
+#define PSTAT_THREAD_WAIT	0x00800
+#define PSTAT_ARGS		0x01000
+#define PSTAT_ENV		0x02000
+#define PSTAT_STATE		0x04000
+#define PSTAT_OWNER_UID		0x08000
+
+#define PSTAT_STATE_P_STOP	0x00001
+#define PSTAT_STATE_P_ZOMBIE	0x00002
+#define PSTAT_STATE_T_RUN	0x00004
+#define PSTAT_STATE_T_HALT	0x00008
+#define PSTAT_STATE_T_WAIT	0x00010
+#define PSTAT_STATE_T_SLEEP	0x00020
+#define PSTAT_STATE_T_IDLE	0x00040
+#define PSTAT_STATE_P_STATES	(PSTAT_STATE_P_STOP | PSTAT_STATE_P_ZOMBIE)
+#define PSTAT_STATE_T_STATES	(PSTAT_STATE_T_RUN | PSTAT_STATE_T_HALT \
+				 | PSTAT_STATE_T_WAIT | PSTAT_STATE_T_SLEEP \
+				 | PSTAT_STATE_T_IDLE)
+
+extern const char *proc_stat_state_tags;
+
+struct procinfo
+{
+  int state;
+  uid_t owner;
+  pid_t ppid;
+  pid_t pgrp;
+  pid_t session;
+  pid_t logincollection;
+  int nthreads;
+};
+
+struct ps_context
+{
+  process_t server;
+};
+
+struct proc_stat
+{
+  pid_t pid;
+  ps_flags_t flags;
+  ps_flags_t failed;
+  struct ps_context *context;
+
+  /* The thread number for thread proc_stats, or -1.  */
+  int thread_index;
+
+  struct procinfo *proc_info;
+  size_t proc_info_size;
+  struct task_basic_info task_basic_info;
+  struct thread_basic_info thread_basic_info;
+  unsigned num_threads;
+  int state;
+  int owner_uid;
+  unsigned long thread_rpc;
+
+  char *args;
+  size_t args_len;
+  int args_vm_alloced;
+  char *env;
+  size_t env_len;
+  int env_vm_alloced;
+};
+
+#define proc_stat_pid(ps)		((ps)->pid)
+#define proc_stat_flags(ps)		((ps)->flags)
+#define proc_stat_proc_info(ps)		((ps)->proc_info)
+#define proc_stat_task_basic_info(ps)	(&(ps)->task_basic_info)
+#define proc_stat_thread_basic_info(ps)	(&(ps)->thread_basic_info)
+#define proc_stat_num_threads(ps)	((ps)->num_threads)
+#define proc_stat_state(ps)		((ps)->state)
+#define proc_stat_owner_uid(ps)		((ps)->owner_uid)
+#define proc_stat_thread_rpc(ps)	((ps)->thread_rpc)
+#define proc_stat_args(ps)		((ps)->args)
+#define proc_stat_args_len(ps)		((ps)->args_len)
+#define proc_stat_env(ps)		((ps)->env)
+#define proc_stat_env_len(ps)		((ps)->env_len)
+
+error_t ps_context_create (process_t server, struct ps_context **pc);
+error_t _proc_stat_create (pid_t pid, struct ps_context *context,
+			   struct proc_stat **ps);
+void _proc_stat_free (struct proc_stat *ps);
+error_t proc_stat_set_flags (struct proc_stat *ps, ps_flags_t flags);
+error_t proc_stat_thread_create (struct proc_stat *ps, unsigned index,
+				 struct proc_stat **thread_ps);
+
+#endif /* __SIM_HURD_H__ */
@@ -0,0 +1,8 @@
+/* Simulated <sys/mman.h>, see sim-hurd.h.  On the Hurd, MAP_PRIVATE is 0,
+   so that the anonymous mappings are private unless MAP_SHARED is
+   given.  */
+
+#include_next <sys/mman.h>
+
+#undef MAP_ANONYMOUS
+#define MAP_ANONYMOUS	(0x20 | MAP_PRIVATE)
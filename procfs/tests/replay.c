@@ -0,0 +1,601 @@
+/* Hurd /proc filesystem, replay of the access patterns of common tools.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <error.h>
+#include <argp.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "sim.h"
+
+/* This benchmark replays the sequences of requests which ps, top,
+   pidstat and monitoring agents make, against the procfs core running on
+   a simulated system.  Each workload is run for a number of sweeps, with
+   a fraction of the processes replaced between them, and the latency of
+   each request (lookup, read or readdir) is recorded.  One line is
+   printed for each workload and number of processes, with the latency
+   percentiles in microseconds, the throughput in requests per second and
+   the number of simulated RPCs made by procfs.
+
+   The workloads are run in child processes, so that each of them starts
+   with a fresh procfs.
+
+   With --startup, the latency of the first requests made to a procfs
+   which has just been started is measured instead, with and without
+   --prewarm: when procfs is a passive translator, the client which
+   triggered its start waits for these.  */
+
+/* Options */
+static char *opt_processes = "100,1000,10000,100000";
+static int opt_sweeps = 3;
+static int opt_rpc_cost = 0;
+static int opt_churn = 1;
+static const char *opt_workload;
+static int opt_startup;
+
+
+/* The timed requests */
+
+struct replay_stats
+{
+  double *latencies;
+  size_t num, size;
+};
+
+static struct replay_stats stats;
+
+static double
+replay_now (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Record the latency of the request started at START.  */
+static void
+replay_note (double start)
+{
+  double end = replay_now ();
+
+  if (stats.num == stats.size)
+    {
+      stats.size = stats.size ? 2 * stats.size : 1 << 16;
+      stats.latencies = realloc (stats.latencies,
+				 stats.size * sizeof *stats.latencies);
+      if (! stats.latencies)
+	error (1, ENOMEM, "Could not record the latencies");
+    }
+
+  stats.latencies[stats.num++] = (end - start) * 1e6;
+}
+
+static struct sim_file *
+replay_open (const char *path)
+{
+  struct sim_file *file;
+  double start;
+  error_t err;
+
+  start = replay_now ();
+  err = sim_open (path, &file);
+  replay_note (start);
+
+  return err ? NULL : file;
+}
+
+/* Read FILE until the end, with a buffer of the size stdio uses.  */
+static error_t
+replay_read (struct sim_file *file)
+{
+  char buf[4096];
+  size_t len;
+  double start;
+  error_t err;
+
+  do
+    {
+      len = sizeof buf;
+      start = replay_now ();
+      err = sim_read (file, buf, &len);
+      replay_note (start);
+    }
+  while (! err && len);
+
+  return err;
+}
+
+/* Read the file PATH from the beginning, as most tools do.  */
+static void
+replay_cat (const char *path)
+{
+  struct sim_file *file;
+
+  file = replay_open (path);
+  if (! file)
+    return;
+
+  replay_read (file);
+  sim_close (file);
+}
+
+/* Read the file of the process PID named NAME.  */
+static void
+replay_cat_process (pid_t pid, const char *name)
+{
+  char path[32];
+
+  snprintf (path, sizeof path, "%d/%s", pid, name);
+  replay_cat (path);
+}
+
+struct replay_pids
+{
+  pid_t *pids;
+  int num, size;
+};
+
+static void
+replay_add_pid (const char *name, void *arg)
+{
+  struct replay_pids *p = arg;
+  char *end;
+  long pid;
+
+  pid = strtol (name, &end, 10);
+  if (*end || end == name)
+    return;
+
+  if (p->num == p->size)
+    {
+      p->size = p->size ? 2 * p->size : 1024;
+      p->pids = realloc (p->pids, p->size * sizeof *p->pids);
+      if (! p->pids)
+	error (1, ENOMEM, "Could not list the processes");
+    }
+
+  p->pids[p->num++] = pid;
+}
+
+/* List the root directory in a single request, as readdir() does, and
+   put the PIDs found there into PIDS.  */
+static void
+replay_list (struct replay_pids *pids)
+{
+  struct sim_file *file;
+  double start;
+  int amt;
+  error_t err;
+
+  pids->num = 0;
+  file = replay_open ("");
+  if (! file)
+    return;
+
+  do
+    {
+      start = replay_now ();
+      err = sim_readdir (file, -1, &amt, replay_add_pid, pids);
+      replay_note (start);
+    }
+  while (! err && amt);
+
+  sim_close (file);
+}
+
+
+/* The workloads */
+
+static struct replay_pids replay_pids;
+
+/* ps aux reads the memory size and the uptime to compute the
+   percentages, and then three files for each process.  */
+static void
+replay_ps (void)
+{
+  int i;
+
+  replay_cat ("uptime");
+  replay_cat ("meminfo");
+
+  replay_list (&replay_pids);
+  for (i = 0; i < replay_pids.num; i++)
+    {
+      replay_cat_process (replay_pids.pids[i], "stat");
+      replay_cat_process (replay_pids.pids[i], "status");
+      replay_cat_process (replay_pids.pids[i], "cmdline");
+    }
+}
+
+/* Each refresh of top reads the summary files, and the process files it
+   needs for the default columns.  */
+static void
+replay_top (void)
+{
+  int i;
+
+  replay_cat ("uptime");
+  replay_cat ("loadavg");
+  replay_cat ("meminfo");
+  replay_cat ("stat");
+
+  replay_list (&replay_pids);
+  for (i = 0; i < replay_pids.num; i++)
+    {
+      replay_cat_process (replay_pids.pids[i], "stat");
+      replay_cat_process (replay_pids.pids[i], "statm");
+      replay_cat_process (replay_pids.pids[i], "status");
+    }
+}
+
+/* pidstat -p ALL -r reads the uptime and the CPU times, and then the
+   statistics and the memory usage of each process.  */
+static void
+replay_pidstat (void)
+{
+  int i;
+
+  replay_cat ("uptime");
+  replay_cat ("stat");
+
+  replay_list (&replay_pids);
+  for (i = 0; i < replay_pids.num; i++)
+    {
+      replay_cat_process (replay_pids.pids[i], "stat");
+      replay_cat_process (replay_pids.pids[i], "status");
+    }
+}
+
+/* A monitoring agent keeps the files it samples open and reads them
+   again from the beginning at each interval: the system-wide files, and
+   the stat files of a few watched processes, which are replaced when
+   they exit.  It also counts the processes.  */
+static const char *const replay_agent_paths[] = {
+  "stat", "meminfo", "loadavg", "vmstat", "uptime",
+};
+#define REPLAY_AGENT_FILES \
+  (sizeof replay_agent_paths / sizeof replay_agent_paths[0])
+#define REPLAY_AGENT_WATCHED 32
+
+static struct sim_file *replay_agent_files[REPLAY_AGENT_FILES];
+static struct sim_file *replay_agent_watched[REPLAY_AGENT_WATCHED];
+static unsigned int replay_agent_seed = 1;
+
+static void
+replay_agent (void)
+{
+  struct sim_file **file;
+  int i;
+
+  for (i = 0; i < REPLAY_AGENT_FILES; i++)
+    {
+      file = &replay_agent_files[i];
+      if (! *file)
+	*file = replay_open (replay_agent_paths[i]);
+      else
+	sim_rewind (*file);
+
+      if (*file)
+	replay_read (*file);
+    }
+
+  replay_list (&replay_pids);
+
+  for (i = 0; i < REPLAY_AGENT_WATCHED; i++)
+    {
+      char path[32];
+
+      file = &replay_agent_watched[i];
+      if (*file)
+	{
+	  sim_rewind (*file);
+	  if (! replay_read (*file))
+	    continue;
+
+	  /* The process is gone.  */
+	  sim_close (*file);
+	}
+
+      snprintf (path, sizeof path, "%d/stat",
+		sim_random_pid (&replay_agent_seed));
+      *file = replay_open (path);
+      if (*file)
+	replay_read (*file);
+    }
+}
+
+static const struct
+{
+  const char *name;
+  void (*sweep) (void);
+} replay_workloads[] = {
+  { "ps", replay_ps },
+  { "top", replay_top },
+  { "pidstat", replay_pidstat },
+  { "agent", replay_agent },
+};
+#define REPLAY_NUM_WORKLOADS \
+  (sizeof replay_workloads / sizeof replay_workloads[0])
+
+
+/* Running and reporting */
+
+static int
+replay_compare (const void *a, const void *b)
+{
+  double da = * (const double *) a, db = * (const double *) b;
+  return da < db ? -1 : da > db;
+}
+
+static double
+replay_percentile (double p)
+{
+  return stats.latencies[(size_t) (p * (stats.num - 1))];
+}
+
+/* Run the workload W with NUM_PROCS processes, and print the results.  */
+static void
+replay_run (int w, int num_procs)
+{
+  unsigned int seed = num_procs;
+  unsigned long rpcs;
+  double start, secs;
+  int i;
+
+  sim_init (num_procs);
+  sim_set_rpc_cost (opt_rpc_cost);
+
+  secs = 0;
+  rpcs = sim_num_rpcs;
+  for (i = 0; i < opt_sweeps; i++)
+    {
+      if (i > 0)
+	sim_churn (num_procs * opt_churn / 100, &seed);
+
+      start = replay_now ();
+      replay_workloads[w].sweep ();
+      secs += replay_now () - start;
+    }
+  rpcs = sim_num_rpcs - rpcs;
+
+  if (! stats.num)
+    error (1, 0, "No requests were made");
+
+  qsort (stats.latencies, stats.num, sizeof *stats.latencies,
+	 replay_compare);
+  printf ("%-8s %7d %9zu %10.0f %9.2f %8.1f %8.1f %8.1f %9.1f %10.0f\n",
+	  replay_workloads[w].name, num_procs, stats.num, stats.num / secs,
+	  secs * 1000 / opt_sweeps,
+	  replay_percentile (.5), replay_percentile (.9),
+	  replay_percentile (.99), stats.latencies[stats.num - 1],
+	  (double) rpcs / opt_sweeps);
+}
+
+
+/* The startup benchmark */
+
+/* Start procfs with NUM_PROCS processes, prewarming it if PREWARM is
+   nonzero, and make the requests of a client such as ps right away: a
+   stat of the root directory, a listing of it, and reads of the stat file
+   of the first process listed and of meminfo.  Print how long after the
+   start procfs was ready and answered the first request, and the latency
+   of each request, in microseconds.  */
+static void
+replay_startup (int num_procs, int prewarm)
+{
+  struct sim_file *file;
+  struct stat st;
+  double start, ready, first, list, pid_stat, meminfo, t;
+
+  sim_populate (num_procs);
+  start = replay_now ();
+  sim_start (prewarm);
+  ready = replay_now ();
+
+  if (sim_open ("", &file) || sim_stat (file, &st))
+    error (1, 0, "Could not stat the root directory");
+  sim_close (file);
+  first = replay_now ();
+
+  replay_list (&replay_pids);
+  list = replay_now ();
+  if (! replay_pids.num)
+    error (1, 0, "No processes were listed");
+
+  replay_cat_process (replay_pids.pids[0], "stat");
+  pid_stat = replay_now ();
+
+  replay_cat ("meminfo");
+  meminfo = replay_now ();
+
+  t = 1e6;
+  printf ("%-8s %7d %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+	  prewarm ? "yes" : "no", num_procs, (ready - start) * t,
+	  (first - start) * t, (list - first) * t, (pid_stat - list) * t,
+	  (meminfo - pid_stat) * t);
+}
+
+/* Run the startup benchmark for each number of processes, with and
+   without prewarming, as many times as there are sweeps, each time in a
+   fresh child process.  */
+static void
+replay_run_startups (void)
+{
+  char *processes, *n;
+  int prewarm, i, status;
+  pid_t child;
+
+  printf ("%-8s %7s %10s %10s %10s %10s %10s\n",
+	  "prewarm", "procs", "ready-us", "first-us", "readdir-us",
+	  "stat-us", "meminfo-us");
+
+  processes = strdupa (opt_processes);
+  for (n = strtok (processes, ","); n; n = strtok (NULL, ","))
+    {
+      if (atoi (n) <= 0)
+	error (1, 0, "Invalid number of processes: %s", n);
+
+      for (prewarm = 0; prewarm <= 1; prewarm++)
+	for (i = 0; i < opt_sweeps; i++)
+	  {
+	    fflush (stdout);
+	    child = fork ();
+	    if (child < 0)
+	      error (1, errno, "fork");
+	    if (child == 0)
+	      {
+		sim_set_rpc_cost (opt_rpc_cost);
+		replay_startup (atoi (n), prewarm);
+		exit (0);
+	      }
+
+	    if (waitpid (child, &status, 0) < 0
+		|| ! WIFEXITED (status) || WEXITSTATUS (status))
+	      error (1, 0, "The startup failed with %s processes", n);
+	  }
+    }
+}
+
+static error_t
+argp_parser (int key, char *arg, struct argp_state *state)
+{
+  char *endp;
+  long v;
+
+  switch (key)
+    {
+    case 'p':
+      opt_processes = arg;
+      break;
+
+    case 's':
+    case 'c':
+    case 'C':
+      v = strtol (arg, &endp, 10);
+      if (*endp || ! *arg || v < 0 || (key == 's' && v == 0))
+	argp_error (state, "invalid value for -%c: %s", key, arg);
+      else if (key == 's')
+	opt_sweeps = v;
+      else if (key == 'c')
+	opt_rpc_cost = v;
+      else
+	opt_churn = v;
+      break;
+
+    case 'w':
+      opt_workload = arg;
+      break;
+
+    case 'S':
+      opt_startup = 1;
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+
+  return 0;
+}
+
+static const struct argp_option options[] = {
+  { "processes", 'p', "N[,N...]", 0,
+      "Replay the workloads with N processes "
+      "(default: 100,1000,10000,100000)" },
+  { "sweeps", 's', "N", 0,
+      "Run each workload N times (default: 3)" },
+  { "rpc-cost", 'c', "USECS", 0,
+      "Make each simulated RPC take USECS microseconds (default: 0)" },
+  { "churn", 'C', "PERCENT", 0,
+      "Replace PERCENT of the processes between the runs (default: 1)" },
+  { "workload", 'w', "NAME", 0,
+      "Only replay the workload NAME: ps, top, pidstat or agent" },
+  { "startup", 'S', NULL, 0,
+      "Measure the latency of the first requests after procfs is started, "
+      "with and without --prewarm, N times each.  This is only meaningful "
+      "with an RPC cost" },
+  {}
+};
+
+static const struct argp argp = {
+  .options = options,
+  .parser = argp_parser,
+  .doc = "Replay the access patterns of ps, top, pidstat and monitoring "
+         "agents against procfs running on a simulated system.",
+};
+
+int
+main (int argc, char **argv)
+{
+  char *processes, *n;
+  int w, found, status;
+  pid_t child;
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  if (opt_startup)
+    {
+      replay_run_startups ();
+      return 0;
+    }
+
+  found = 0;
+  for (w = 0; w < REPLAY_NUM_WORKLOADS; w++)
+    if (! opt_workload || ! strcmp (opt_workload, replay_workloads[w].name))
+      found = 1;
+  if (! found)
+    error (1, 0, "Unknown workload: %s", opt_workload);
+
+  printf ("%-8s %7s %9s %10s %9s %8s %8s %8s %9s %10s\n",
+	  "workload", "procs", "requests", "req/s", "sweep-ms",
+	  "p50-us", "p90-us", "p99-us", "max-us", "rpcs/sweep");
+
+  for (w = 0; w < REPLAY_NUM_WORKLOADS; w++)
+    {
+      if (opt_workload && strcmp (opt_workload, replay_workloads[w].name))
+	continue;
+
+      processes = strdupa (opt_processes);
+      for (n = strtok (processes, ","); n; n = strtok (NULL, ","))
+	{
+	  if (atoi (n) <= 0)
+	    error (1, 0, "Invalid number of processes: %s", n);
+
+	  fflush (stdout);
+	  child = fork ();
+	  if (child < 0)
+	    error (1, errno, "fork");
+	  if (child == 0)
+	    {
+	      replay_run (w, atoi (n));
+	      exit (0);
+	    }
+
+	  if (waitpid (child, &status, 0) < 0
+	      || ! WIFEXITED (status) || WEXITSTATUS (status))
+	    error (1, 0, "The %s workload failed with %s processes",
+		   replay_workloads[w].name, n);
+	}
+    }
+
+  return 0;
+}
@@ -0,0 +1,1060 @@
+/* Hurd /proc filesystem, simulated system for the tests.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <mach.h>
+#include <hurd.h>
+#include <hurd/netfs.h>
+#include <ps.h>
+#include "../procfs.h"
+#include "../proclist.h"
+#include "../rootdir.h"
+#include "../dircat.h"
+#include "../main.h"
+#include "../prewarm.h"
+#include "sim.h"
+
+__thread int sim_internal;
+unsigned long sim_num_rpcs;
+
+static int sim_rpc_cost;
+
+/* Allocate and free memory on behalf of the simulated libraries.  */
+static void *
+sim_malloc (size_t size)
+{
+  void *p;
+
+  sim_internal++;
+  p = malloc (size);
+  sim_internal--;
+
+  if (! p)
+    abort ();
+
+  return p;
+}
+
+static void
+sim_free (void *p)
+{
+  free (p);
+}
+
+/* Simulate an RPC to another server or to the kernel.  */
+static void
+sim_rpc (void)
+{
+  struct timespec start, now;
+  long usecs;
+
+  __atomic_add_fetch (&sim_num_rpcs, 1, __ATOMIC_RELAXED);
+  if (! sim_rpc_cost)
+    return;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  do
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now);
+      usecs = (now.tv_sec - start.tv_sec) * 1000000
+	+ (now.tv_nsec - start.tv_nsec) / 1000;
+    }
+  while (usecs < sim_rpc_cost);
+}
+
+void
+sim_set_rpc_cost (int usecs)
+{
+  sim_rpc_cost = usecs;
+}
+
+
+/* The options, set to their default values by sim_init() */
+
+int opt_clk_tck;
+mode_t opt_stat_mode;
+pid_t opt_fake_self;
+pid_t opt_kernel_pid;
+uid_t opt_anon_owner;
+int opt_max_workers;
+int opt_idle_timeout;
+int opt_max_slow_generators;
+int opt_client_share;
+int opt_trace_threshold;
+int opt_slab_top;
+int opt_slab_interval;
+int opt_history_interval;
+int opt_pressure_threshold;
+int opt_native_mounts;
+int opt_prewarm;
+
+static void
+sim_set_default_options (void)
+{
+  opt_clk_tck = sysconf (_SC_CLK_TCK);
+  opt_stat_mode = 0400;
+  opt_fake_self = -1;
+  opt_kernel_pid = 2;
+  opt_anon_owner = 0;
+  opt_max_workers = 0;
+  opt_idle_timeout = 120;
+  opt_max_slow_generators = 0;
+  opt_client_share = 0;
+  opt_trace_threshold = 100;
+  opt_slab_top = 10;
+  opt_slab_interval = 60;
+  opt_history_interval = 1;
+  opt_pressure_threshold = 5;
+  opt_native_mounts = 0;
+  opt_prewarm = 0;
+}
+
+
+/* The process table */
+
+struct sim_proc
+{
+  pid_t pid, ppid;
+  uid_t owner;
+  int state;
+  int nthreads;
+  const char *args, *env;
+  size_t args_len, env_len;
+  vm_size_t vsize, rss;
+  time_value_t start;
+};
+
+/* The command lines of the processes, as argz vectors.  */
+static const struct
+{
+  const char *argz;
+  size_t len;
+} sim_commands[] = {
+#define SIM_COMMAND(argz) { argz, sizeof argz }
+  SIM_COMMAND ("/hurd/ext2fs.static\0--multiboot-command-line=root=hd0s1\0"
+	       "--host-priv-port=1\0--device-master-port=2\0/dev/hd0s1"),
+  SIM_COMMAND ("/bin/bash\0-l"),
+  SIM_COMMAND ("/usr/sbin/sshd\0-D"),
+  SIM_COMMAND ("/hurd/term\0/dev/console\0device\0console"),
+  SIM_COMMAND ("/usr/bin/python3\0/usr/lib/agent/collect.py\0--interval=1"),
+  SIM_COMMAND ("/bin/sleep\0" "600"),
+  SIM_COMMAND ("/usr/sbin/cron\0-f"),
+  SIM_COMMAND ("/hurd/pfinet\0-i\0/dev/eth0\0-a\0" "10.0.2.15\0-g\0" "10.0.2.2"),
+#undef SIM_COMMAND
+};
+#define SIM_NUM_COMMANDS (sizeof sim_commands / sizeof sim_commands[0])
+
+static const char sim_environ[] =
+  "HOME=/root\0LANG=C.UTF-8\0LOGNAME=root\0"
+  "PATH=/usr/local/bin:/usr/bin:/bin:/usr/local/sbin:/usr/sbin:/sbin\0"
+  "SHELL=/bin/bash\0TERM=mach-gnu-color\0USER=root";
+
+static pthread_rwlock_t sim_procs_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct sim_proc **sim_procs;
+static pid_t sim_procs_size;
+static pid_t sim_next_pid;
+static int sim_num_procs;
+static time_t sim_boot_time;
+
+/* The number of threads of the kernel process, the last of which is the
+   idle thread.  */
+#define SIM_KERNEL_THREADS 4
+
+/* The number of processes which never exit.  */
+#define SIM_NUM_SERVERS 10
+
+/* Create the process PID.  SIM_PROCS_LOCK must be held for writing.  */
+static void
+sim_spawn (pid_t pid)
+{
+  struct sim_proc *p;
+  int cmd;
+
+  if (pid >= sim_procs_size)
+    {
+      pid_t size = sim_procs_size ? 2 * sim_procs_size : 1024;
+
+      while (pid >= size)
+	size *= 2;
+
+      sim_procs = realloc (sim_procs, size * sizeof *sim_procs);
+      if (! sim_procs)
+	abort ();
+      memset (sim_procs + sim_procs_size, 0,
+	      (size - sim_procs_size) * sizeof *sim_procs);
+      sim_procs_size = size;
+    }
+
+  p = calloc (1, sizeof *p);
+  if (! p)
+    abort ();
+
+  cmd = pid % SIM_NUM_COMMANDS;
+  p->pid = pid;
+  p->ppid = pid > 1 ? 1 : 0;
+  p->owner = pid % 3 ? 1000 + pid % 5 : 0;
+  p->state = pid % 10 ? PSTAT_STATE_T_SLEEP : PSTAT_STATE_T_RUN;
+  p->nthreads = pid == 2 ? SIM_KERNEL_THREADS : 1 + pid % 4;
+  p->args = sim_commands[cmd].argz;
+  p->args_len = sim_commands[cmd].len;
+  p->env = sim_environ;
+  p->env_len = sizeof sim_environ;
+  p->vsize = (64 + pid % 512) << 20;
+  p->rss = (1 + pid % 64) << 20;
+  p->start.seconds = sim_boot_time + pid / 100;
+
+  sim_procs[pid] = p;
+  sim_num_procs++;
+  if (pid >= sim_next_pid)
+    sim_next_pid = pid + 1;
+}
+
+/* Return the process PID, or NULL.  SIM_PROCS_LOCK must be held.  */
+static struct sim_proc *
+sim_find (pid_t pid)
+{
+  return pid > 0 && pid < sim_procs_size ? sim_procs[pid] : NULL;
+}
+
+pid_t
+sim_random_pid (unsigned int *seed)
+{
+  pid_t pid;
+
+  pthread_rwlock_rdlock (&sim_procs_lock);
+  do
+    pid = 1 + rand_r (seed) % (sim_next_pid - 1);
+  while (! sim_find (pid));
+  pthread_rwlock_unlock (&sim_procs_lock);
+
+  return pid;
+}
+
+void
+sim_churn (int n, unsigned int *seed)
+{
+  pid_t pid;
+
+  pthread_rwlock_wrlock (&sim_procs_lock);
+  while (n--)
+    {
+      /* The first few processes are the system servers, which stay.  */
+      if (sim_num_procs > SIM_NUM_SERVERS)
+	{
+	  do
+	    pid = 1 + rand_r (seed) % (sim_next_pid - 1);
+	  while (pid <= SIM_NUM_SERVERS || ! sim_find (pid));
+
+	  free (sim_procs[pid]);
+	  sim_procs[pid] = NULL;
+	  sim_num_procs--;
+	}
+
+      sim_spawn (sim_next_pid);
+    }
+  pthread_rwlock_unlock (&sim_procs_lock);
+}
+
+error_t
+proc_getallpids (process_t proc, pidarray_t *pids,
+		 mach_msg_type_number_t *num_pids)
+{
+  pid_t pid;
+  int n;
+
+  sim_rpc ();
+
+  pthread_rwlock_rdlock (&sim_procs_lock);
+  *pids = sim_malloc (sim_num_procs * sizeof **pids);
+  for (pid = 1, n = 0; pid < sim_next_pid; pid++)
+    if (sim_procs[pid])
+      (*pids)[n++] = pid;
+  *num_pids = n;
+  pthread_rwlock_unlock (&sim_procs_lock);
+
+  return 0;
+}
+
+error_t
+proc_pid2proc (process_t proc, pid_t pid, process_t *p)
+{
+  sim_rpc ();
+  *p = 1000 + pid;
+  return 0;
+}
+
+error_t
+proc_is_important (process_t p, boolean_t *essential)
+{
+  sim_rpc ();
+  *essential = p - 1000 <= 4;
+  return 0;
+}
+
+error_t
+proc_get_code (process_t p, vm_address_t *start, vm_address_t *end)
+{
+  sim_rpc ();
+  *start = 0x1000;
+  *end = 0x1000 + (p - 1000) * PAGE_SIZE;
+  return 0;
+}
+
+process_t
+getproc (void)
+{
+  return 3;
+}
+
+
+/* libps */
+
+const char *proc_stat_state_tags = "TZRHDSIWN<u+slfmpoxwg";
+
+error_t
+ps_context_create (process_t server, struct ps_context **pc)
+{
+  *pc = sim_malloc (sizeof **pc);
+  (*pc)->server = server;
+  return 0;
+}
+
+error_t
+_proc_stat_create (pid_t pid, struct ps_context *context,
+		   struct proc_stat **ps)
+{
+  /* Likewise, libps allocates the proc_stat structure for procfs.  */
+  *ps = malloc (sizeof **ps);
+  if (! *ps)
+    abort ();
+  memset (*ps, 0, sizeof **ps);
+  (*ps)->pid = pid;
+  (*ps)->flags = PSTAT_PID;
+  (*ps)->context = context;
+  (*ps)->thread_index = -1;
+  return 0;
+}
+
+void
+_proc_stat_free (struct proc_stat *ps)
+{
+  if (ps->proc_info)
+    vm_deallocate (mach_task_self (), (vm_address_t) ps->proc_info,
+		   ps->proc_info_size);
+  if (ps->args)
+    vm_deallocate (mach_task_self (), (vm_address_t) ps->args, ps->args_len);
+  if (ps->env)
+    vm_deallocate (mach_task_self (), (vm_address_t) ps->env, ps->env_len);
+  sim_free (ps);
+}
+
+error_t
+proc_stat_thread_create (struct proc_stat *ps, unsigned index,
+			 struct proc_stat **thread_ps)
+{
+  error_t err;
+
+  err = _proc_stat_create (ps->pid, ps->context, thread_ps);
+  if (! err)
+    (*thread_ps)->thread_index = index;
+
+  return err;
+}
+
+/* Fill in the information of the thread INDEX of P into TBI.  */
+static void
+sim_thread_info (struct sim_proc *p, int index,
+		 struct thread_basic_info *tbi)
+{
+  memset (tbi, 0, sizeof *tbi);
+  tbi->user_time.seconds = p->pid % 100;
+  tbi->system_time.seconds = p->pid % 10;
+  tbi->base_priority = tbi->cur_priority = 12;
+  tbi->creation_time = p->start;
+  if (p->pid == 2 && index == SIM_KERNEL_THREADS - 1)
+    tbi->flags = TH_FLAGS_IDLE;
+}
+
+/* Copy LEN bytes of DATA into a buffer out-of-line, as returned by the
+   RPCs.  */
+static char *
+sim_copy_out (const char *data, size_t len)
+{
+  vm_address_t addr;
+
+  vm_allocate (mach_task_self (), &addr, len, 1);
+  memcpy ((char *) addr, data, len);
+  return (char *) addr;
+}
+
+error_t
+proc_stat_set_flags (struct proc_stat *ps, ps_flags_t flags)
+{
+  const ps_flags_t procinfo_flags = PSTAT_PROC_INFO | PSTAT_STATE
+    | PSTAT_OWNER_UID | PSTAT_NUM_THREADS | PSTAT_THREAD_WAIT;
+  ps_flags_t need = flags & ~ps->flags;
+  struct sim_proc *p;
+  int i;
+
+  if (! need)
+    return 0;
+
+  pthread_rwlock_rdlock (&sim_procs_lock);
+  p = sim_find (ps->pid);
+  if (! p)
+    {
+      /* The process is gone.  */
+      ps->failed |= need;
+      pthread_rwlock_unlock (&sim_procs_lock);
+      return 0;
+    }
+
+  if (need & procinfo_flags)
+    {
+      sim_rpc ();
+      if (! ps->proc_info)
+	{
+	  vm_address_t addr;
+
+	  ps->proc_info_size = sizeof *ps->proc_info;
+	  vm_allocate (mach_task_self (), &addr, ps->proc_info_size, 1);
+	  ps->proc_info = (struct procinfo *) addr;
+	}
+      ps->proc_info->owner = p->owner;
+      ps->proc_info->ppid = p->ppid;
+      ps->proc_info->pgrp = p->pid;
+      ps->proc_info->session = p->ppid > 1 ? p->ppid : p->pid;
+      ps->proc_info->nthreads = p->nthreads;
+      ps->state = p->state;
+      ps->owner_uid = p->owner;
+      ps->num_threads = p->nthreads;
+      ps->thread_rpc = 0;
+      ps->flags |= procinfo_flags;
+    }
+
+  if (need & (PSTAT_TASK | PSTAT_THREAD))
+    {
+      sim_rpc ();
+      ps->flags |= PSTAT_TASK | PSTAT_THREAD;
+    }
+
+  if (need & PSTAT_TASK_BASIC)
+    {
+      sim_rpc ();
+      memset (&ps->task_basic_info, 0, sizeof ps->task_basic_info);
+      ps->task_basic_info.virtual_size = p->vsize;
+      ps->task_basic_info.resident_size = p->rss;
+      ps->task_basic_info.creation_time = p->start;
+      ps->flags |= PSTAT_TASK_BASIC;
+    }
+
+  if (need & PSTAT_THREAD_BASIC)
+    {
+      /* libps adds up the information of all the threads.  */
+      if (ps->thread_index >= 0)
+	{
+	  sim_rpc ();
+	  sim_thread_info (p, ps->thread_index, &ps->thread_basic_info);
+	}
+      else
+	for (i = 0; i < p->nthreads; i++)
+	  {
+	    sim_rpc ();
+	    sim_thread_info (p, i, &ps->thread_basic_info);
+	  }
+      ps->flags |= PSTAT_THREAD_BASIC;
+    }
+
+  if (need & PSTAT_ARGS)
+    {
+      sim_rpc ();
+      ps->args = sim_copy_out (p->args, p->args_len);
+      ps->args_len = p->args_len;
+      ps->args_vm_alloced = 1;
+      ps->flags |= PSTAT_ARGS;
+    }
+
+  if (need & PSTAT_ENV)
+    {
+      sim_rpc ();
+      ps->env = sim_copy_out (p->env, p->env_len);
+      ps->env_len = p->env_len;
+      ps->env_vm_alloced = 1;
+      ps->flags |= PSTAT_ENV;
+    }
+
+  ps->flags |= need & (PSTAT_PID | PSTAT_PROCESS | PSTAT_MSGPORT
+		       | PSTAT_TASK_EVENTS | PSTAT_THREAD_SCHED);
+  pthread_rwlock_unlock (&sim_procs_lock);
+
+  return 0;
+}
+
+
+/* GNU Mach and the Hurd servers */
+
+mach_port_t
+mach_task_self (void)
+{
+  return 1;
+}
+
+mach_port_t
+mach_host_self (void)
+{
+  return 2;
+}
+
+thread_t
+mach_thread_self (void)
+{
+  return 7;
+}
+
+kern_return_t
+mach_port_deallocate (mach_port_t task, mach_port_t name)
+{
+  return 0;
+}
+
+kern_return_t
+task_get_bootstrap_port (mach_port_t task, mach_port_t *port)
+{
+  *port = 4;
+  return 0;
+}
+
+kern_return_t
+vm_allocate (mach_port_t task, vm_address_t *addr, vm_size_t size,
+	     boolean_t anywhere)
+{
+  *addr = (vm_address_t) sim_malloc (size ?: 1);
+  return 0;
+}
+
+kern_return_t
+vm_deallocate (mach_port_t task, vm_address_t addr, vm_size_t size)
+{
+  sim_free ((void *) addr);
+  return 0;
+}
+
+kern_return_t
+host_info (mach_port_t host, int flavor, host_info_t info,
+	   mach_msg_type_number_t *count)
+{
+  sim_rpc ();
+
+  switch (flavor)
+    {
+    case HOST_BASIC_INFO:
+      {
+	host_basic_info_data_t *hbi = (host_basic_info_data_t *) info;
+
+	memset (hbi, 0, sizeof *hbi);
+	hbi->max_cpus = hbi->avail_cpus = 1;
+	hbi->memory_size = 2047U << 20;
+	*count = HOST_BASIC_INFO_COUNT;
+	return 0;
+      }
+
+    case HOST_LOAD_INFO:
+      {
+	host_load_info_data_t *hli = (host_load_info_data_t *) info;
+
+	memset (hli, 0, sizeof *hli);
+	hli->avenrun[0] = 520;
+	hli->avenrun[1] = 310;
+	hli->avenrun[2] = 150;
+	*count = HOST_LOAD_INFO_COUNT;
+	return 0;
+      }
+    }
+
+  return EINVAL;
+}
+
+kern_return_t
+vm_statistics (mach_port_t task, struct vm_statistics *stats)
+{
+  sim_rpc ();
+  memset (stats, 0, sizeof *stats);
+  stats->pagesize = PAGE_SIZE;
+  stats->free_count = 300000;
+  stats->active_count = 120000;
+  stats->inactive_count = 80000;
+  stats->wire_count = 20000;
+  stats->pageins = 4000;
+  stats->faults = 2000000;
+  return 0;
+}
+
+kern_return_t
+vm_cache_statistics (mach_port_t task, struct vm_cache_statistics *stats)
+{
+  sim_rpc ();
+  memset (stats, 0, sizeof *stats);
+  stats->cache_count = 50000;
+  return 0;
+}
+
+kern_return_t
+default_pager_info (mach_port_t pager, default_pager_info_t *info)
+{
+  sim_rpc ();
+  info->dpi_total_space = 1U << 30;
+  info->dpi_free_space = 1U << 29;
+  info->dpi_page_size = PAGE_SIZE;
+  return 0;
+}
+
+kern_return_t
+host_slab_info (mach_port_t host, cache_info_array_t *info,
+		mach_msg_type_number_t *count)
+{
+  static const char *const names[] = {
+    "vm_object", "vm_map_entry", "ipc_port", "thread", "task", "kmem_64",
+  };
+  vm_address_t addr;
+  int i;
+
+  sim_rpc ();
+  *count = sizeof names / sizeof names[0];
+  vm_allocate (mach_task_self (), &addr, *count * sizeof **info, 1);
+  *info = (cache_info_array_t) addr;
+  memset (*info, 0, *count * sizeof **info);
+  for (i = 0; i < *count; i++)
+    {
+      strcpy ((*info)[i].name, names[i]);
+      (*info)[i].obj_size = 64 << i;
+      (*info)[i].slab_size = PAGE_SIZE;
+      (*info)[i].bufs_per_slab = PAGE_SIZE / (64 << i) ?: 1;
+      (*info)[i].nr_slabs = 100 >> i;
+      (*info)[i].nr_free_slabs = 10 >> i;
+      (*info)[i].nr_objs = (*info)[i].nr_bufs = 1000 >> i;
+    }
+
+  return 0;
+}
+
+file_t
+file_name_lookup (const char *name, int flags, mode_t mode)
+{
+  sim_rpc ();
+  return 5;
+}
+
+file_t
+getcrdir (void)
+{
+  return 6;
+}
+
+/* The RPCs never block, so there is nothing to cancel.  */
+error_t
+hurd_thread_cancel (thread_t thread)
+{
+  return 0;
+}
+
+int
+hurd_check_cancel (void)
+{
+  return 0;
+}
+
+/* The translators can't be walked, so --native-mounts is not
+   supported.  */
+error_t
+file_getcontrol (file_t file, fsys_t *control)
+{
+  sim_rpc ();
+  return EOPNOTSUPP;
+}
+
+error_t
+fsys_get_options (fsys_t control, data_t *options,
+		  mach_msg_type_number_t *options_len)
+{
+  return EOPNOTSUPP;
+}
+
+error_t
+fsys_get_source (fsys_t control, string_t source)
+{
+  return EOPNOTSUPP;
+}
+
+error_t
+fsys_get_children (fsys_t control, data_t *names,
+		   mach_msg_type_number_t *names_len, portarray_t *controls,
+		   mach_msg_type_number_t *controls_len)
+{
+  return EOPNOTSUPP;
+}
+
+
+/* libports, libiohelp and libfshelp */
+
+struct port_bucket *netfs_port_bucket;
+struct port_class *netfs_control_class;
+
+void *
+ports_lookup_port (struct port_bucket *bucket, mach_port_t port,
+		   struct port_class *class)
+{
+  return NULL;
+}
+
+void
+ports_port_deref (void *port)
+{
+}
+
+error_t
+iohelp_dup_iouser (struct iouser **clone, struct iouser *iouser)
+{
+  struct iouser *u;
+  struct idvec *v;
+  int i;
+
+  u = sim_malloc (sizeof *u);
+  u->hook = NULL;
+  for (i = 0; i < 2; i++)
+    {
+      struct idvec *from = i ? iouser->gids : iouser->uids;
+
+      v = sim_malloc (sizeof *v);
+      v->num = v->alloced = from->num;
+      v->ids = sim_malloc ((from->num ?: 1) * sizeof *v->ids);
+      memcpy (v->ids, from->ids, from->num * sizeof *v->ids);
+      if (i)
+	u->gids = v;
+      else
+	u->uids = v;
+    }
+
+  *clone = u;
+  return 0;
+}
+
+void
+iohelp_free_iouser (struct iouser *iouser)
+{
+  sim_free (iouser->uids->ids);
+  sim_free (iouser->uids);
+  sim_free (iouser->gids->ids);
+  sim_free (iouser->gids);
+  sim_free (iouser);
+}
+
+error_t
+fshelp_access (struct stat *st, int op, struct iouser *user)
+{
+  uid_t uid = user->uids->num ? user->uids->ids[0] : (uid_t) -1;
+
+  if (uid == 0)
+    return 0;
+  if (uid == st->st_uid)
+    return st->st_mode & op ? 0 : EACCES;
+
+  return st->st_mode & (op >> 6) ? 0 : EACCES;
+}
+
+
+/* libnetfs */
+
+pthread_spinlock_t netfs_node_refcnt_lock;
+struct node *netfs_root_node;
+
+struct node *
+netfs_make_node (struct netnode *nn)
+{
+  struct node *np;
+
+  /* libnetfs allocates the node for procfs, so unlike those of the rest
+     of the simulated system, this allocation is one of procfs.  */
+  np = malloc (sizeof *np);
+  if (! np)
+    abort ();
+  memset (np, 0, sizeof *np);
+  np->nn = nn;
+  np->references = 1;
+  pthread_mutex_init (&np->lock, NULL);
+  return np;
+}
+
+void
+netfs_nref (struct node *np)
+{
+  pthread_spin_lock (&netfs_node_refcnt_lock);
+  np->references++;
+  pthread_spin_unlock (&netfs_node_refcnt_lock);
+}
+
+void
+netfs_nrele (struct node *np)
+{
+  pthread_spin_lock (&netfs_node_refcnt_lock);
+  assert (np->references > 0);
+  if (--np->references == 0)
+    netfs_node_norefs (np);
+  pthread_spin_unlock (&netfs_node_refcnt_lock);
+}
+
+void
+netfs_nput (struct node *np)
+{
+  pthread_mutex_unlock (&np->lock);
+  netfs_nrele (np);
+}
+
+error_t
+netfs_append_args (char **argz, size_t *argz_len)
+{
+  return 0;
+}
+
+
+/* The clients */
+
+struct sim_file
+{
+  struct node *np;
+  struct iouser *user;
+  loff_t offset;
+};
+
+/* The clients are all root, and each open has its own copy.  */
+static uid_t sim_root_id;
+static struct idvec sim_root_ids = { &sim_root_id, 1, 1 };
+static struct iouser sim_root_user = { &sim_root_ids, &sim_root_ids };
+
+error_t
+sim_open (const char *path, struct sim_file **file)
+{
+  struct node *np, *next;
+  char *name, *names, *p;
+  error_t err;
+
+  names = strdupa (path);
+
+  np = netfs_root_node;
+  netfs_nref (np);
+  pthread_mutex_lock (&np->lock);
+
+  /* Look up each component and validate its status, as dir_lookup
+     does.  */
+  err = netfs_validate_stat (np, &sim_root_user);
+  for (name = strtok_r (names, "/", &p);
+       name && ! err;
+       name = strtok_r (NULL, "/", &p))
+    {
+      err = netfs_attempt_lookup (&sim_root_user, np, name, &next);
+      netfs_nrele (np);
+      if (err)
+	return err;
+
+      np = next;
+      err = netfs_validate_stat (np, &sim_root_user);
+    }
+
+  if (! err)
+    err = netfs_check_open_permissions (&sim_root_user, np, O_READ, 0);
+  if (err)
+    {
+      netfs_nput (np);
+      return err;
+    }
+
+  pthread_mutex_unlock (&np->lock);
+
+  *file = sim_malloc (sizeof **file);
+  memset (*file, 0, sizeof **file);
+  (*file)->np = np;
+  iohelp_dup_iouser (&(*file)->user, &sim_root_user);
+  return 0;
+}
+
+error_t
+sim_read (struct sim_file *file, char *buf, size_t *len)
+{
+  error_t err;
+
+  pthread_mutex_lock (&file->np->lock);
+  err = netfs_attempt_read (file->user, file->np, file->offset, len, buf);
+  pthread_mutex_unlock (&file->np->lock);
+
+  if (! err)
+    file->offset += *len;
+
+  return err;
+}
+
+error_t
+sim_read_all (struct sim_file *file, size_t *len)
+{
+  char buf[4096];
+  size_t n;
+  error_t err;
+
+  *len = 0;
+  do
+    {
+      n = sizeof buf;
+      err = sim_read (file, buf, &n);
+      *len += n;
+    }
+  while (! err && n);
+
+  return err;
+}
+
+void
+sim_rewind (struct sim_file *file)
+{
+  file->offset = 0;
+}
+
+error_t
+sim_readdir (struct sim_file *file, int nentries, int *amt,
+	     void (*fn) (const char *name, void *arg), void *arg)
+{
+  /* The buffer of the reply message, which netfs_get_dirents() replaces
+     with one it maps itself if it is too small.  */
+  char buf[2048];
+  mach_msg_type_number_t datacnt;
+  char *data, *p;
+  int i;
+  error_t err;
+
+  data = buf;
+  pthread_mutex_lock (&file->np->lock);
+  err = netfs_get_dirents (file->user, file->np, file->offset, nentries,
+			   &data, &datacnt, sizeof buf, amt);
+  pthread_mutex_unlock (&file->np->lock);
+  if (err)
+    return err;
+
+  for (p = data, i = 0; i < *amt; i++)
+    {
+      struct dirent *d = (struct dirent *) p;
+
+      if (fn)
+	fn (d->d_name, arg);
+      p += d->d_reclen;
+    }
+
+  if (data != buf)
+    munmap (data, datacnt);
+
+  file->offset += *amt;
+  return 0;
+}
+
+error_t
+sim_stat (struct sim_file *file, struct stat *st)
+{
+  error_t err;
+
+  pthread_mutex_lock (&file->np->lock);
+  err = netfs_validate_stat (file->np, file->user);
+  if (! err)
+    *st = file->np->nn_stat;
+  pthread_mutex_unlock (&file->np->lock);
+
+  return err;
+}
+
+void
+sim_close (struct sim_file *file)
+{
+  iohelp_free_iouser (file->user);
+  netfs_nrele (file->np);
+  sim_free (file);
+}
+
+
+/* Create the root node of procfs, as root_make_node() does in main.c.  */
+static error_t
+sim_make_root (struct ps_context *pc, struct node **np)
+{
+  struct node *root_dirs[] = {
+    proclist_make_node (pc),
+    rootdir_make_node (pc),
+  };
+
+  *np = dircat_make_node (root_dirs, sizeof root_dirs / sizeof root_dirs[0]);
+  if (! *np)
+    return ENOMEM;
+
+  (*np)->nn_stat.st_ino = * (uint32_t *) "PROC";
+  return 0;
+}
+
+void
+sim_init (int num_procs)
+{
+  sim_populate (num_procs);
+  sim_start (0);
+}
+
+void
+sim_populate (int num_procs)
+{
+  pid_t pid;
+
+  sim_set_default_options ();
+  pthread_spin_init (&netfs_node_refcnt_lock, PTHREAD_PROCESS_PRIVATE);
+
+  sim_boot_time = time (NULL) - 86400;
+  for (pid = 1; pid <= num_procs; pid++)
+    sim_spawn (pid);
+}
+
+void
+sim_start (int prewarm)
+{
+  struct ps_context *pc;
+  error_t err;
+
+  opt_prewarm = prewarm;
+  prewarm_begin ();
+
+  err = ps_context_create (getproc (), &pc);
+  if (! err)
+    err = sim_make_root (pc, &netfs_root_node);
+  if (! err && opt_prewarm)
+    err = prewarm_start (pc);
+  if (err)
+    {
+      fprintf (stderr, "Could not create the root node: %s\n",
+	       strerror (err));
+      exit (1);
+    }
+
+  /* netfs_startup() hands the control port to the parent translator.  */
+  sim_rpc ();
+  prewarm_note_ready ();
+}
@@ -0,0 +1,87 @@
+/* Hurd /proc filesystem, simulated system for the tests.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <sys/stat.h>
+#include <hurd/netfs.h>
+
+/* The simulated system has a table of processes standing for the proc
+   server, and implements the parts of libnetfs, libps and GNU Mach which
+   procfs uses on top of it.  The clients access procfs through the
+   sim_open() family of functions below, which call the libnetfs
+   callbacks of netfs.c in the same way as the RPC handlers of libnetfs
+   do.  */
+
+/* Nonzero while the current thread runs the simulated libraries and
+   servers, as opposed to procfs itself.  The allocations made meanwhile
+   are not those of procfs.  */
+extern __thread int sim_internal;
+
+/* The number of simulated RPCs made so far.  */
+extern unsigned long sim_num_rpcs;
+
+/* Create a system with NUM_PROCS processes, set the options to their
+   default values and create the root node of procfs, as main() does.  */
+void sim_init (int num_procs);
+
+/* The two steps of sim_init(): create a system with NUM_PROCS processes
+   and set the options to their default values, and then start procfs as
+   main() does, including the RPC made by netfs_startup(), with --prewarm
+   if PREWARM is nonzero.  The prewarming runs in the background, so it
+   may still be under way when sim_start() returns.  */
+void sim_populate (int num_procs);
+void sim_start (int prewarm);
+
+/* Make each simulated RPC take USECS microseconds.  */
+void sim_set_rpc_cost (int usecs);
+
+/* Make N random processes exit, and start N new ones.  */
+void sim_churn (int n, unsigned int *seed);
+
+/* Return the PID of a random process.  */
+pid_t sim_random_pid (unsigned int *seed);
+
+/* An open file of procfs, with its own iouser and offset.  */
+struct sim_file;
+
+/* Open PATH, relative to the root of procfs, for reading.  */
+error_t sim_open (const char *path, struct sim_file **file);
+
+/* Read up to *LEN bytes from FILE into BUF, and set *LEN to the number of
+   bytes read.  */
+error_t sim_read (struct sim_file *file, char *buf, size_t *len);
+
+/* Read the whole contents of FILE from its current offset, and set *LEN
+   to their length.  */
+error_t sim_read_all (struct sim_file *file, size_t *len);
+
+/* Go back to the beginning of FILE.  */
+void sim_rewind (struct sim_file *file);
+
+/* Read up to NENTRIES entries from the directory FILE, or all of them if
+   NENTRIES is -1, and call FN with the name of each of them and ARG.
+   Set *AMT to the number of entries read, which is 0 at the end of the
+   directory.  */
+error_t sim_readdir (struct sim_file *file, int nentries, int *amt,
+		     void (*fn) (const char *name, void *arg), void *arg);
+
+/* Get the status of FILE.  */
+error_t sim_stat (struct sim_file *file, struct stat *st);
+
+/* Close FILE.  */
+void sim_close (struct sim_file *file);
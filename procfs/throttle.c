@@ -0,0 +1,219 @@
+/* Hurd /proc filesystem, limits on concurrent activities.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <sys/types.h>
+#include <time.h>
+#include <hurd/iohelp.h>
+#include "throttle.h"
+#include "main.h"
+
+struct throttle throttle_slow_generators
+  = THROTTLE_INITIALIZER (&opt_max_slow_generators);
+
+void
+throttle_enter (struct throttle *t)
+{
+  pthread_mutex_lock (&t->lock);
+  while (*t->max > 0 && t->active >= *t->max)
+    pthread_cond_wait (&t->cond, &t->lock);
+  t->active++;
+  pthread_mutex_unlock (&t->lock);
+}
+
+void
+throttle_leave (struct throttle *t)
+{
+  pthread_mutex_lock (&t->lock);
+  t->active--;
+  pthread_cond_broadcast (&t->cond);
+  pthread_mutex_unlock (&t->lock);
+}
+
+
+/* Per-client accounting */
+
+/* The number of clients tracked at once.  When there are more, the one
+   which has been inactive for the longest time is forgotten.  */
+#define THROTTLE_CLIENTS 64
+
+/* How many seconds worth of their share the clients can use in a row
+   before they are slowed down.  */
+#define THROTTLE_BURST 2
+
+/* The maximum delay imposed at once, in milliseconds.  */
+#define THROTTLE_MAX_DELAY 1000
+
+/* The clients are told apart by their whole credentials, that is all of
+   their user and group IDs, which are hashed into a key.  The Hurd tells
+   the server nothing else about them, so the clients with the same
+   credentials share the same account.  */
+struct throttle_client
+{
+  size_t key;
+  int used;
+
+  /* The generation time used beyond the share of the client, in
+     milliseconds, as of UPDATED.  */
+  double debt;
+  struct timespec updated;
+};
+
+static pthread_mutex_t throttle_clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct throttle_client throttle_clients[THROTTLE_CLIENTS];
+
+/* The client of the current thread, if any.  */
+static __thread int throttle_current_valid;
+static __thread size_t throttle_current_key;
+static __thread uid_t throttle_current_uid;
+
+/* FNV-1a over the IDs of USER.  Unauthenticated users all share the same
+   account.  */
+static size_t
+throttle_user_key (struct iouser *user)
+{
+  struct idvec *sets[] = { user->uids, user->gids };
+  size_t h = 2166136261u;
+  unsigned i, j;
+
+  for (i = 0; i < sizeof sets / sizeof sets[0]; i++)
+    {
+      for (j = 0; j < sets[i]->num; j++)
+	h = (h ^ sets[i]->ids[j]) * 16777619u;
+
+      /* Separate the user IDs from the group IDs.  */
+      h = (h ^ (size_t) -1) * 16777619u;
+    }
+
+  return h;
+}
+
+void
+throttle_client_begin (struct iouser *user)
+{
+  throttle_current_key = throttle_user_key (user);
+  throttle_current_uid = user->uids->num ? user->uids->ids[0] : (uid_t) -1;
+  throttle_current_valid = 1;
+}
+
+void
+throttle_client_end (void)
+{
+  throttle_current_valid = 0;
+}
+
+int
+throttle_client_uid (uid_t *uid)
+{
+  if (throttle_current_valid)
+    *uid = throttle_current_uid;
+
+  return throttle_current_valid;
+}
+
+/* Find the client with KEY, or allocate it, and bring its debt up to
+   date.  Must be called with throttle_clients_lock held.  */
+static struct throttle_client *
+throttle_find_client (size_t key)
+{
+  struct throttle_client *c, *oldest = NULL;
+  struct timespec now;
+  double elapsed;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  for (c = throttle_clients; c < throttle_clients + THROTTLE_CLIENTS; c++)
+    {
+      if (c->used && c->key == key)
+	break;
+
+      if (! oldest || ! c->used
+	  || (oldest->used
+	      && (c->updated.tv_sec < oldest->updated.tv_sec
+		  || (c->updated.tv_sec == oldest->updated.tv_sec
+		      && c->updated.tv_nsec < oldest->updated.tv_nsec))))
+	oldest = c;
+    }
+
+  if (c == throttle_clients + THROTTLE_CLIENTS)
+    {
+      c = oldest;
+      c->key = key;
+      c->used = 1;
+      c->debt = 0;
+    }
+  else
+    {
+      elapsed = (now.tv_sec - c->updated.tv_sec)
+	+ (now.tv_nsec - c->updated.tv_nsec) / 1e9;
+      c->debt -= elapsed * opt_client_share;
+      if (c->debt < 0)
+	c->debt = 0;
+    }
+
+  c->updated = now;
+  return c;
+}
+
+void
+throttle_client_charge (double ms)
+{
+  if (! throttle_current_valid || opt_client_share <= 0)
+    return;
+
+  pthread_mutex_lock (&throttle_clients_lock);
+  throttle_find_client (throttle_current_key)->debt += ms;
+  pthread_mutex_unlock (&throttle_clients_lock);
+}
+
+/* Return the delay of the client with KEY.  */
+static int
+throttle_delay (size_t key)
+{
+  double excess;
+
+  pthread_mutex_lock (&throttle_clients_lock);
+  excess = throttle_find_client (key)->debt
+    - (double) opt_client_share * THROTTLE_BURST;
+  pthread_mutex_unlock (&throttle_clients_lock);
+
+  if (excess <= 0)
+    return 0;
+
+  /* Wait until the excess has been paid back.  */
+  excess = excess * 1000 / opt_client_share;
+  return excess < THROTTLE_MAX_DELAY ? (int) excess + 1 : THROTTLE_MAX_DELAY;
+}
+
+int
+throttle_client_delay (void)
+{
+  if (! throttle_current_valid || opt_client_share <= 0)
+    return 0;
+
+  return throttle_delay (throttle_current_key);
+}
+
+int
+throttle_user_delay (struct iouser *user)
+{
+  if (opt_client_share <= 0)
+    return 0;
+
+  return throttle_delay (throttle_user_key (user));
+}
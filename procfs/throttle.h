@@ -0,0 +1,73 @@
+/* Hurd /proc filesystem, limits on concurrent activities.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <pthread.h>
+#include <hurd/iohelp.h>
+
+/* A limit on the number of threads doing something at the same time.  */
+struct throttle
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int active;
+
+  /* Points to the maximum, or to zero for no limit.  It can be changed at
+     any time, and is taken into account the next time a thread enters
+     or leaves.  */
+  const int *max;
+};
+
+#define THROTTLE_INITIALIZER(max) \
+  { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, (max) }
+
+/* Wait until T allows one more thread in, and account for the caller.  */
+void throttle_enter (struct throttle *t);
+
+/* Account for the caller leaving T.  */
+void throttle_leave (struct throttle *t);
+
+/* The number of process files being generated at once which need to
+   read the memory of the process, as per --max-slow-generators.  */
+extern struct throttle throttle_slow_generators;
+
+
+/* Per-client admission control.  The time spent generating contents and
+   looking up nodes is charged to the user on whose behalf the current
+   thread works, and the users who use more than their share, as per
+   --client-share, are slowed down.  */
+
+/* Make USER the client of the current thread, until throttle_client_end
+   is called.  */
+void throttle_client_begin (struct iouser *user);
+void throttle_client_end (void);
+
+/* If the current thread has a client, store its UID in *UID and return
+   nonzero.  */
+int throttle_client_uid (uid_t *uid);
+
+/* Charge MS milliseconds of generation time to the current client.  */
+void throttle_client_charge (double ms);
+
+/* Return the number of milliseconds the current client should wait
+   before more contents are generated on its behalf, or zero if it is
+   within its share.  */
+int throttle_client_delay (void);
+
+/* Likewise for USER, whether or not it is the current client.  */
+int throttle_user_delay (struct iouser *user);
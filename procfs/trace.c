@@ -0,0 +1,190 @@
+/* Hurd /proc filesystem, trace of the slow requests.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ps.h>
+#include "procfs.h"
+#include "throttle.h"
+#include "trace.h"
+#include "main.h"
+
+/* The number of records kept.  */
+#define TRACE_SIZE 256
+
+struct trace_record
+{
+  /* Twice the index of the record plus one while it is being written,
+     and plus two once it is complete, so that readers can tell when
+     they raced with a writer.  */
+  unsigned long seq;
+
+  struct timeval when;
+  uid_t uid;
+  ino64_t ino;
+  const char *name;
+  pid_t pid;
+  const char *kind;
+  ps_flags_t needs;
+  double total;
+  double phases[TRACE_NUM_PHASES];
+};
+
+/* The ring buffer.  Writers claim a slot by incrementing trace_next, and
+   never wait for each other or for readers.  */
+static struct trace_record trace_records[TRACE_SIZE];
+static unsigned long trace_next;
+
+/* The generation in progress in the current thread.  */
+static __thread int trace_depth;
+static __thread struct trace_record trace_current;
+
+static const char *const trace_phase_names[TRACE_NUM_PHASES] = {
+  [TRACE_WAIT] = "wait",
+  [TRACE_FETCH] = "fetch",
+  [TRACE_FORMAT] = "format",
+};
+
+void
+trace_begin (void)
+{
+  if (trace_depth++ == 0)
+    memset (&trace_current, 0, sizeof trace_current);
+}
+
+void
+trace_note_process (pid_t pid, const char *kind, ps_flags_t needs)
+{
+  if (trace_depth > 1)
+    return;
+
+  trace_current.pid = pid;
+  trace_current.kind = kind;
+  trace_current.needs = needs;
+}
+
+void
+trace_note_phase (enum trace_phase phase, double ms)
+{
+  trace_current.phases[phase] += ms;
+}
+
+double
+trace_ms_since (const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e3
+    + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void
+trace_end (ino64_t ino, const char *name, double ms)
+{
+  struct trace_record *r;
+  unsigned long seq;
+
+  if (--trace_depth > 0 || opt_trace_threshold <= 0
+      || ms < opt_trace_threshold)
+    return;
+
+  trace_current.ino = ino;
+  trace_current.name = name;
+  trace_current.total = ms;
+  gettimeofday (&trace_current.when, NULL);
+  if (! throttle_client_uid (&trace_current.uid))
+    trace_current.uid = -1;
+
+  seq = __atomic_fetch_add (&trace_next, 1, __ATOMIC_RELAXED);
+  r = &trace_records[seq % TRACE_SIZE];
+
+  __atomic_store_n (&r->seq, 2 * seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+
+  trace_current.seq = 2 * seq + 1;
+  *r = trace_current;
+
+  __atomic_store_n (&r->seq, 2 * seq + 2, __ATOMIC_RELEASE);
+}
+
+static error_t
+trace_get_contents (void *hook, char **contents, ssize_t *contents_len)
+{
+  struct trace_record r;
+  unsigned long next, seq, i;
+  size_t len;
+  FILE *m;
+  int p;
+
+  m = open_memstream (contents, &len);
+  if (! m)
+    return ENOMEM;
+
+  /* Go through the records from the oldest one.  */
+  next = __atomic_load_n (&trace_next, __ATOMIC_ACQUIRE);
+  for (i = next > TRACE_SIZE ? next - TRACE_SIZE : 0; i < next; i++)
+    {
+      struct trace_record *slot = &trace_records[i % TRACE_SIZE];
+
+      seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+      if (seq != 2 * i + 2)
+	continue;
+
+      r = *slot;
+      __atomic_thread_fence (__ATOMIC_ACQUIRE);
+      if (__atomic_load_n (&slot->seq, __ATOMIC_RELAXED) != seq)
+	continue;
+
+      fprintf (m, "%ld.%06ld uid=%d ino=%llu name=%s",
+	       (long) r.when.tv_sec, (long) r.when.tv_usec, (int) r.uid,
+	       (unsigned long long) r.ino, r.name);
+      if (r.kind)
+	fprintf (m, " pid=%d file=%s needs=%#llx", r.pid, r.kind,
+		 (unsigned long long) r.needs);
+      fprintf (m, " total=%.3f", r.total);
+      for (p = 0; p < TRACE_NUM_PHASES; p++)
+	if (r.phases[p] > 0)
+	  fprintf (m, " %s=%.3f", trace_phase_names[p], r.phases[p]);
+      fputc ('\n', m);
+    }
+
+  fclose (m);
+  *contents_len = len;
+  return 0;
+}
+
+struct node *
+trace_make_node (void)
+{
+  static const struct procfs_node_ops ops = {
+    .get_contents = trace_get_contents,
+    .cleanup_contents = procfs_cleanup_contents_with_free,
+  };
+  struct node *np;
+
+  /* The records reveal who reads what, so only the owner of the server
+     can see them.  */
+  np = procfs_make_node (&ops, NULL);
+  if (np)
+    procfs_node_chmod (np, 0400);
+
+  return np;
+}
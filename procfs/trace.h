@@ -0,0 +1,61 @@
+/* Hurd /proc filesystem, trace of the slow requests.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <time.h>
+#include <ps.h>
+
+/* The generations of contents which take longer than --trace-threshold
+   are recorded in a ring buffer, along with some details provided by the
+   generator through the trace_note_* functions below.  */
+
+/* The phases of the generation of process files.  */
+enum trace_phase
+{
+  TRACE_WAIT,		/* waiting for --max-slow-generators */
+  TRACE_FETCH,		/* retrieving the information through libps */
+  TRACE_FORMAT,		/* formatting the contents */
+  TRACE_NUM_PHASES
+};
+
+/* Start timing a generation of contents in the current thread.  The
+   generations which happen while another one is in progress, such as
+   those of the directories merged by dircat, are accounted for as part of
+   it.  */
+void trace_begin (void);
+
+/* End the generation started with trace_begin, of the node with inode
+   number INO, named NAME, which took MS milliseconds.  NAME is the kind
+   of the node instead when its name is not known, and must be static,
+   since it is recorded as is.  */
+void trace_end (ino64_t ino, const char *name, double ms);
+
+/* Note that the current generation is that of the file KIND of the
+   process PID, which needs the information designated by NEEDS.  This is
+   ignored in the generations which happen while another one is in
+   progress, so that they don't pass off as the outer one.  */
+void trace_note_process (pid_t pid, const char *kind, ps_flags_t needs);
+
+/* Note that PHASE of the current generation took MS milliseconds.  */
+void trace_note_phase (enum trace_phase phase, double ms);
+
+/* Return the number of milliseconds elapsed since START.  */
+double trace_ms_since (const struct timespec *start);
+
+/* Create a file listing the recorded slow generations.  */
+struct node *trace_make_node (void);
@@ -0,0 +1,343 @@
+/* Hurd /proc filesystem, bounded pool of server threads.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <mach.h>
+#include <mach/mig_errors.h>
+#include <hurd/ports.h>
+#include "workers.h"
+
+/* libports creates a new thread for each message which arrives while
+   all of its threads are busy, so that the number of threads is only
+   bounded by that of the concurrent requests.  With --max-workers, the
+   server uses this pool instead: a single thread receives the messages
+   through libports, and queues the requests for the worker threads,
+   which serve them the same way the threads of libports do.
+
+   The requests of the clients over their share, as per --client-share,
+   are held in the queue until their delay has passed, rather than by a
+   worker thread, so that they can't keep the other clients from being
+   served.  */
+
+/* A request waiting for a worker thread.  */
+struct workers_request
+{
+  struct workers_request *next;
+
+  /* If DELAYED is set, the request is not served before NOT_BEFORE.  */
+  int delayed;
+  struct timespec not_before;
+
+  /* The message, which is msg.msgh_size bytes long.  */
+  mach_msg_header_t msg;
+};
+
+/* This protects the variables below.  */
+static pthread_mutex_t workers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Signaled when a request is queued.  */
+static pthread_cond_t workers_queued = PTHREAD_COND_INITIALIZER;
+
+/* The queued requests, oldest first, and their number.  */
+static struct workers_request *workers_head;
+static struct workers_request **workers_tail = &workers_head;
+static int workers_num_queued;
+/* How many of them are delayed.  */
+static int workers_num_delayed;
+
+/* The number of requests queued or being served.  */
+static int workers_pending;
+
+/* The number of worker threads, and of those waiting for a request.  */
+static int workers_threads;
+static int workers_idle;
+
+/* The parameters of workers_manage.  */
+static struct port_bucket *workers_bucket;
+static ports_demuxer_type workers_demuxer;
+static int (*workers_delay) (mach_msg_header_t *inp);
+static const int *workers_max;
+static int workers_thread_timeout;
+
+/* Serve the request INP, and send the reply built in OUTP, like the
+   threads of libports and mach_msg_server do.  */
+static void
+workers_serve (mach_msg_header_t *inp, mig_reply_header_t *outp)
+{
+  static const mach_msg_type_t RetCodeType = {
+    MACH_MSG_TYPE_INTEGER_32, 32, 1, TRUE, FALSE, FALSE, 0
+  };
+  struct port_info *pi;
+  struct rpc_info link;
+  error_t err;
+
+  outp->Head.msgh_bits = MACH_MSGH_BITS (MACH_MSGH_BITS_REMOTE (inp->msgh_bits),
+					 0);
+  outp->Head.msgh_size = sizeof *outp;
+  outp->Head.msgh_remote_port = inp->msgh_remote_port;
+  outp->Head.msgh_local_port = MACH_PORT_NULL;
+  outp->Head.msgh_seqno = 0;
+  outp->Head.msgh_id = inp->msgh_id + 100;
+  outp->RetCodeType = RetCodeType;
+  outp->RetCode = MIG_BAD_ID;
+
+  /* The port may have been destroyed while the request was queued.  */
+  pi = ports_lookup_port (workers_bucket, inp->msgh_local_port, 0);
+  if (pi)
+    {
+      err = ports_begin_rpc (pi, inp->msgh_id, &link);
+      if (err)
+	outp->RetCode = err;
+      else
+	{
+	  workers_demuxer (inp, &outp->Head);
+	  ports_end_rpc (pi, &link);
+	}
+      ports_port_deref (pi);
+    }
+  else
+    outp->RetCode = EOPNOTSUPP;
+
+  switch (outp->RetCode)
+    {
+    case KERN_SUCCESS:
+      break;
+
+    case MIG_NO_REPLY:
+      return;
+
+    default:
+      /* The rights and memory of the request were not consumed, except
+	 for the reply port, which is used below.  */
+      inp->msgh_remote_port = MACH_PORT_NULL;
+      mach_msg_destroy (inp);
+      break;
+    }
+
+  if (outp->Head.msgh_remote_port == MACH_PORT_NULL)
+    {
+      if (outp->Head.msgh_bits & MACH_MSGH_BITS_COMPLEX)
+	mach_msg_destroy (&outp->Head);
+      return;
+    }
+
+  /* Don't block on clients which don't receive their replies.  */
+  err = mach_msg (&outp->Head,
+		  MACH_SEND_MSG
+		  | (MACH_MSGH_BITS_REMOTE (outp->Head.msgh_bits)
+		     == MACH_MSG_TYPE_MOVE_SEND_ONCE ? 0 : MACH_SEND_TIMEOUT),
+		  outp->Head.msgh_size, 0, MACH_PORT_NULL,
+		  MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+  if (err == MACH_SEND_INVALID_DEST || err == MACH_SEND_TIMED_OUT)
+    mach_msg_destroy (&outp->Head);
+}
+
+/* Set *T to MS milliseconds from now.  */
+static void
+workers_deadline (struct timespec *t, int ms)
+{
+  clock_gettime (CLOCK_REALTIME, t);
+  t->tv_sec += ms / 1000;
+  t->tv_nsec += ms % 1000 * 1000000;
+  if (t->tv_nsec >= 1000000000)
+    {
+      t->tv_sec++;
+      t->tv_nsec -= 1000000000;
+    }
+}
+
+static int
+workers_before (const struct timespec *a, const struct timespec *b)
+{
+  return a->tv_sec < b->tv_sec
+    || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/* Dequeue the oldest request which can be served now, if any.  Otherwise
+   return NULL, and if there are delayed requests, set *WAKE to the time
+   the first of them can be served and *DELAYED to 1.  Must be called with
+   workers_lock held.  */
+static struct workers_request *
+workers_take (struct timespec *wake, int *delayed)
+{
+  struct workers_request *r, **p;
+  struct timespec now;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  *delayed = 0;
+
+  for (p = &workers_head; (r = *p); p = &r->next)
+    {
+      if (! r->delayed || ! workers_before (&now, &r->not_before))
+	{
+	  *p = r->next;
+	  if (! *p)
+	    workers_tail = p;
+	  workers_num_queued--;
+	  if (r->delayed)
+	    workers_num_delayed--;
+	  return r;
+	}
+
+      if (! *delayed || workers_before (&r->not_before, wake))
+	*wake = r->not_before;
+      *delayed = 1;
+    }
+
+  return NULL;
+}
+
+static void *
+workers_thread (void *arg)
+{
+  /* The reply buffer has the same size as that of mach_msg_server.  */
+  mig_reply_header_t *reply = alloca (4 * vm_page_size);
+  struct workers_request *r;
+  struct timespec idle_deadline, wake;
+  int delayed;
+
+  pthread_mutex_lock (&workers_lock);
+  for (;;)
+    {
+      workers_deadline (&idle_deadline, workers_thread_timeout);
+
+      /* The thread only exits when there is nothing left to serve.  */
+      workers_idle++;
+      while (! (r = workers_take (&wake, &delayed)))
+	if (delayed)
+	  pthread_cond_timedwait (&workers_queued, &workers_lock, &wake);
+	else if (! workers_thread_timeout)
+	  pthread_cond_wait (&workers_queued, &workers_lock);
+	else if (pthread_cond_timedwait (&workers_queued, &workers_lock,
+					 &idle_deadline) == ETIMEDOUT
+		 && ! workers_head)
+	  break;
+      workers_idle--;
+
+      if (! r)
+	break;
+
+      pthread_mutex_unlock (&workers_lock);
+
+      workers_serve (&r->msg, reply);
+      free (r);
+
+      pthread_mutex_lock (&workers_lock);
+      workers_pending--;
+    }
+
+  workers_threads--;
+  pthread_mutex_unlock (&workers_lock);
+  return NULL;
+}
+
+/* The demuxer of the receiving thread.  */
+static int
+workers_receive (mach_msg_header_t *inp, mach_msg_header_t *outp)
+{
+  struct workers_request *r;
+  pthread_t thread;
+  int delay;
+
+  if (ports_interrupt_server_routine (inp)
+      || ports_notify_server_routine (inp))
+    return workers_demuxer (inp, outp);
+
+  r = malloc (offsetof (struct workers_request, msg) + inp->msgh_size);
+  if (! r)
+    return workers_demuxer (inp, outp);
+
+  memcpy (&r->msg, inp, inp->msgh_size);
+  r->next = NULL;
+
+  delay = workers_delay ? workers_delay (inp) : 0;
+  r->delayed = delay > 0;
+  if (r->delayed)
+    workers_deadline (&r->not_before, delay);
+
+  /* A delayed request only needs a thread to exist, since it doesn't
+     have to be served as soon as possible.  */
+  pthread_mutex_lock (&workers_lock);
+  if ((r->delayed
+       ? ! workers_threads
+       : workers_num_queued - workers_num_delayed >= workers_idle)
+      && (*workers_max <= 0 || workers_threads < *workers_max)
+      && ! pthread_create (&thread, NULL, workers_thread, NULL))
+    {
+      pthread_detach (thread);
+      workers_threads++;
+    }
+
+  /* No thread could be created to serve the request, so serve it here
+     rather than queue it forever.  */
+  if (! workers_threads)
+    {
+      pthread_mutex_unlock (&workers_lock);
+      free (r);
+      return workers_demuxer (inp, outp);
+    }
+
+  *workers_tail = r;
+  workers_tail = &r->next;
+  workers_num_queued++;
+  workers_num_delayed += r->delayed;
+  workers_pending++;
+
+  /* The threads waiting for a later delayed request must see this one.  */
+  if (r->delayed)
+    pthread_cond_broadcast (&workers_queued);
+  else
+    pthread_cond_signal (&workers_queued);
+  pthread_mutex_unlock (&workers_lock);
+
+  /* The worker owns the request now, and will send the reply.  */
+  ((mig_reply_header_t *) outp)->RetCode = MIG_NO_REPLY;
+  return 1;
+}
+
+void
+workers_manage (struct port_bucket *bucket, ports_demuxer_type demuxer,
+		int (*delay) (mach_msg_header_t *inp),
+		const int *max, int thread_timeout, int global_timeout)
+{
+  int pending;
+
+  pthread_mutex_lock (&workers_lock);
+  workers_bucket = bucket;
+  workers_demuxer = demuxer;
+  workers_delay = delay;
+  workers_max = max;
+  workers_thread_timeout = thread_timeout;
+  pthread_mutex_unlock (&workers_lock);
+
+  do
+    {
+      ports_manage_port_operations_one_thread (bucket, workers_receive,
+					       global_timeout);
+
+      pthread_mutex_lock (&workers_lock);
+      pending = workers_pending;
+      pthread_mutex_unlock (&workers_lock);
+    }
+  while (pending);
+}
@@ -0,0 +1,38 @@
+/* Hurd /proc filesystem, bounded pool of server threads.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <hurd/ports.h>
+
+/* Serve the requests of BUCKET with DEMUXER, using at most *MAX threads
+   at once, which can be changed at any time.  A single thread receives
+   the messages and queues the requests until a worker thread is free,
+   so that no more threads are created than that.  The interrupts and
+   the notifications are served at once by the receiving thread, since
+   they may be what the busy workers are waiting for.  The worker
+   threads exit after being idle for THREAD_TIMEOUT milliseconds, if it
+   is nonzero.  Like ports_manage_port_operations_multithread, return
+   once nothing has been received for GLOBAL_TIMEOUT milliseconds, if it
+   is nonzero, and all the queued requests have been served.  If DELAY
+   is not NULL, it is called for each request and the requests for which
+   it returns a positive number of milliseconds are kept in the queue
+   that long, without using a thread meanwhile.  A *MAX of 0 means no
+   limit.  */
+void workers_manage (struct port_bucket *bucket, ports_demuxer_type demuxer,
+		     int (*delay) (mach_msg_header_t *inp),
+		     const int *max, int thread_timeout, int global_timeout);